@@ -24,8 +24,14 @@
 // Std headers
 #include <stddef.h>
 #include <stdio.h>
+#include <string.h>
 #include <stdarg.h>
 
+#ifdef HD44780_TRACE
+// libopencm3 headers
+#include <libopencm3/cm3/dwt.h>
+#endif
+
 // Local headers
 #include "include/helper.h"
 #include "include/hd44780.h"
@@ -68,29 +74,182 @@
 /// Address counter
 #define FLAGS_AC_MASK           0x7F
 
-extern void sleep_ms(uint32_t ms);
+/* Execution times, fosc = 270 kHz */
+/// Enable pulse width and cycle, us
+#define HD44780_E_PULSE_US      (1)
+/// Most of instructions, us
+#define HD44780_EXEC_US         (37)
+/// Data write to CG or DD RAM, us
+#define HD44780_EXEC_DATA_US    (41)
+/// Clear display and return home, us
+#define HD44780_EXEC_LONG_US    (1520)
+
+/// Size of deferred transfers queue, should be power of 2
+#ifndef HD44780_QUEUE_SIZE
+#define HD44780_QUEUE_SIZE      (128)
+#endif
+
+/// Level of RS line isn't known
+#define HD44780_RS_UNKNOWN      0xFF
+
+/// Display shift isn't known
+#define HD44780_SHIFT_UNKNOWN   0xFF
+
+/// Queue entry is data, otherwise instruction
+#define QUEUE_RS                0x100
+/// Queue entry selects displays of group, low byte is a mask
+#define QUEUE_SELECT            0x200
+
+/// Size of DDRAM address space
+#define HD44780_DDRAM_SIZE      (0x80)
+
+/// Size of CGRAM address space
+#define HD44780_CGRAM_SIZE      (0x40)
+
+/// DDRAM address of warm restart signature - 2 cells out of visible area of
+/// not shifted display with up to 2 lines
+#ifndef HD44780_SIGNATURE_ADDR
+#define HD44780_SIGNATURE_ADDR  (0x26)
+#endif
+#define HD44780_SIGNATURE_0     0xA5
+#define HD44780_SIGNATURE_1     0x5A
+
+/// Number of cells verified per slice
+#ifndef HD44780_VERIFY_SLICE
+#define HD44780_VERIFY_SLICE    (4)
+#endif
+
+/// Period of verification slices, us
+#ifndef HD44780_VERIFY_PERIOD_US
+#define HD44780_VERIFY_PERIOD_US (10000)
+#endif
+
+/// Number of measurements of every instruction on calibration
+#ifndef HD44780_CALIBRATE_RUNS
+#define HD44780_CALIBRATE_RUNS  (4)
+#endif
+
+/// Busy flag timeout on calibration, us
+#define HD44780_CALIBRATE_TIMEOUT_US (10000)
+
+#ifdef HD44780_TRACE
+/// Timestamp of trace entries, DWT cycle counter should be enabled by application
+#ifndef HD44780_TRACE_TIMESTAMP
+#define HD44780_TRACE_TIMESTAMP() DWT_CYCCNT
+#endif
+
+static struct {
+	struct hd44780_trace_entry entries[HD44780_TRACE_SIZE];
+	/// Number of recorded entries, wraps around
+	uint32_t head;
+} hd44780_trace_ring;
+#endif
 
 struct position_s {
     uint8_t x;
     uint8_t y;
 };
 
+/// GPIO pins of one port
+struct port_gpios_s {
+	uint32_t port;
+	uint16_t gpios;
+};
+
+/// Datasheet execution times, fosc = 270 kHz
+static const struct hd44780_timing hd44780_timing_datasheet = {
+	.exec_us = {
+		[HD44780_OP_CLEAR] = HD44780_EXEC_LONG_US,
+		[HD44780_OP_HOME] = HD44780_EXEC_LONG_US,
+		[HD44780_OP_ENTRY_MODE] = HD44780_EXEC_US,
+		[HD44780_OP_DISPLAY_CTRL] = HD44780_EXEC_US,
+		[HD44780_OP_SHIFT] = HD44780_EXEC_US,
+		[HD44780_OP_FUNCTION_SET] = HD44780_EXEC_US,
+		[HD44780_OP_CGRAM_ADDR] = HD44780_EXEC_US,
+		[HD44780_OP_DDRAM_ADDR] = HD44780_EXEC_US,
+		[HD44780_OP_DATA] = HD44780_EXEC_DATA_US,
+	},
+};
+
 static struct
 {
   uint8_t width;
+  uint8_t num_lines;
   bool bus8;
+  /// RnW line is wired, so data can be read back
+  bool readable;
+  /// Current level of RS line, HD44780_RS_UNKNOWN after init
+  uint8_t rs_level;
   struct hd44780_bus *bus;
+  /// Data lines grouped by port
+  struct port_gpios_s data_ports[8];
+  uint8_t num_data_ports;
+  /// Displays sharing the bus, may be NULL
+  struct hd44780_group *group;
+  /// E lines of displays selected on the bus, grouped by port
+  struct port_gpios_s e_ports[HD44780_GROUP_MAX + 1];
+  uint8_t num_e_ports;
+  /// Selected displays, bit N is display N
+  uint8_t e_mask;
   struct position_s position;
-} hd44780_params;
+  /// Controller is ready for next transfer at this time, micros()
+  uint32_t ready_at;
+  /// Transfers are queued and performed by hd44780_step()
+  bool deferred;
+  uint16_t queue[HD44780_QUEUE_SIZE];
+  uint16_t head;
+  uint16_t tail;
+
+  /* Expected controller state, when all queued transfers are done */
+  /// DDRAM content
+  uint8_t ddram[HD44780_DDRAM_SIZE];
+  /// CGRAM content
+  uint8_t cgram[HD44780_CGRAM_SIZE];
+  /// CGRAM content was written or read back since init
+  bool cgram_known;
+  /// Address counter
+  uint8_t ac;
+  /// Address counter points to CGRAM
+  bool ac_cgram;
+  /// Address counter was set since init
+  bool ac_known;
+  /// Display shift left, modulo line length, HD44780_SHIFT_UNKNOWN after init
+  uint8_t shift;
+  /// Last entry mode instruction
+  uint8_t entry;
+  /// Last display control instruction
+  uint8_t display;
+  /// Last function set instruction
+  uint8_t function;
+
+  /// Execution times used for open-loop timing
+  const struct hd44780_timing *timing;
+  /// Instructions removed from bus
+  struct hd44780_elide_stats elide;
+
+  /* DDRAM verifier */
+  struct {
+    uint8_t slice;
+    uint32_t period;
+    /// Time of next slice
+    uint32_t next;
+    /// Next cell to be verified
+    uint8_t pos;
+    struct hd44780_verify_stats stats;
+  } verify;
+} hd44780_params = {
+  .timing = &hd44780_timing_datasheet,
+};
 
 /**
- * @brief Write half-byte
+ * @brief Set RS line, it's written only if level changes
  * @param rs	True if data, otherwise instructin register
- * @param	data	Half of data byte
  */
-static void hd44780_write_half_byte(bool rs, uint8_t data)
+static void hd44780_bus_rs(bool rs)
 {
-	gpio_clear(hd44780_params.bus->rnw.port, hd44780_params.bus->rnw.gpio);
+	if (hd44780_params.rs_level == rs) {
+		return;
+	}
 
 	if (rs) {
 		gpio_set(hd44780_params.bus->rs.port, hd44780_params.bus->rs.gpio);
@@ -98,6 +257,129 @@ static void hd44780_write_half_byte(bool rs, uint8_t data)
 		gpio_clear(hd44780_params.bus->rs.port, hd44780_params.bus->rs.gpio);
 	}
 
+	hd44780_params.rs_level = rs;
+}
+
+/**
+ * @brief Add GPIO to list of pins grouped by port
+ * @param ports	List of pins grouped by port
+ * @param num	Number of ports in list
+ * @param line	GPIO to be added
+ */
+static void hd44780_add_gpio(struct port_gpios_s *ports, uint8_t *num, const struct hd44780_gpio *line)
+{
+	uint8_t i;
+
+	for (i = 0; i < *num; i++) {
+		if (ports[i].port == line->port) {
+			break;
+		}
+	}
+
+	if (i == *num) {
+		ports[i].port = line->port;
+		ports[i].gpios = 0;
+		(*num)++;
+	}
+
+	ports[i].gpios |= line->gpio;
+}
+
+/**
+ * @brief Select displays strobed by E
+ * @param mask	Displays, bit 0 is E of bus, bit N is E N-1 of group
+ */
+static void hd44780_select_e(uint8_t mask)
+{
+	uint8_t i;
+
+	hd44780_params.e_mask = mask;
+	hd44780_params.num_e_ports = 0;
+
+	if (mask & 0x01) {
+		hd44780_add_gpio(hd44780_params.e_ports, &hd44780_params.num_e_ports, &hd44780_params.bus->e);
+	}
+
+	for (i = 0; hd44780_params.group && i < hd44780_params.group->num; i++) {
+		if (mask & (0x02 << i)) {
+			hd44780_add_gpio(hd44780_params.e_ports, &hd44780_params.num_e_ports, &hd44780_params.group->e[i]);
+		}
+	}
+}
+
+/**
+ * @brief Pulse E line, data lines should be set
+ */
+static void hd44780_strobe(void)
+{
+	uint8_t i;
+
+	// All selected displays latch the same bus cycle
+	for (i = 0; i < hd44780_params.num_e_ports; i++) {
+		gpio_set(hd44780_params.e_ports[i].port, hd44780_params.e_ports[i].gpios);
+	}
+	sleep_us(HD44780_E_PULSE_US);
+
+	for (i = 0; i < hd44780_params.num_e_ports; i++) {
+		gpio_clear(hd44780_params.e_ports[i].port, hd44780_params.e_ports[i].gpios);
+	}
+	sleep_us(HD44780_E_PULSE_US);
+}
+
+/**
+ * @brief Decode instruction
+ * @param data	Instruction byte, not zero
+ * @return	Instruction, enum hd44780_op
+ */
+static inline uint8_t hd44780_instruction_op(uint8_t data)
+{
+	// Instruction is defined by the highest bit set
+	return 31 - __builtin_clz(data);
+}
+
+#ifdef HD44780_TRACE
+/**
+ * @brief Record bus transaction into trace ring buffer
+ * @param flags	HD44780_TRACE_xxx flags
+ * @param data	Data byte or half-byte
+ */
+static inline void hd44780_trace(uint8_t flags, uint8_t data)
+{
+	struct hd44780_trace_entry *entry;
+	uint8_t op;
+
+	if (flags & HD44780_TRACE_NIBBLE) {
+		op = HD44780_OP_NIBBLE;
+	} else if (flags & HD44780_TRACE_RNW) {
+		op = (flags & HD44780_TRACE_RS) ? HD44780_OP_READ : HD44780_OP_BUSY;
+	} else if (flags & HD44780_TRACE_RS) {
+		op = HD44780_OP_DATA;
+	} else if (data) {
+		op = hd44780_instruction_op(data);
+	} else {
+		op = HD44780_OP_NONE;
+	}
+
+	entry = &hd44780_trace_ring.entries[hd44780_trace_ring.head++ & (HD44780_TRACE_SIZE - 1)];
+	entry->timestamp = HD44780_TRACE_TIMESTAMP();
+	entry->flags = flags;
+	entry->data = data;
+	entry->op = op;
+	entry->displays = hd44780_params.e_mask;
+}
+#else
+#define hd44780_trace(flags, data)
+#endif
+
+/**
+ * @brief Write half-byte, not traced
+ * @param rs	True if data, otherwise instructin register
+ * @param	data	Half of data byte
+ */
+static void hd44780_bus_half_byte(bool rs, uint8_t data)
+{
+	hd44780_bus_rs(rs);
+
 	if (data & 0x08)
 		gpio_set(hd44780_params.bus->db7.port, hd44780_params.bus->db7.gpio);
 	else
@@ -118,10 +400,18 @@ static void hd44780_write_half_byte(bool rs, uint8_t data)
 	else
 		gpio_clear(hd44780_params.bus->db4.port, hd44780_params.bus->db4.gpio);
 
-	gpio_set(hd44780_params.bus->e.port, hd44780_params.bus->e.gpio);
-	sleep_ms(1);
-	gpio_clear(hd44780_params.bus->e.port, hd44780_params.bus->e.gpio);
-	sleep_ms(1);
+	hd44780_strobe();
+}
+
+/**
+ * @brief Write half-byte
+ * @param rs	True if data, otherwise instructin register
+ * @param	data	Half of data byte
+ */
+static void hd44780_write_half_byte(bool rs, uint8_t data)
+{
+	hd44780_trace(HD44780_TRACE_NIBBLE | (rs ? HD44780_TRACE_RS : 0), data & 0x0F);
+	hd44780_bus_half_byte(rs, data);
 }
 
 /**
@@ -131,13 +421,8 @@ static void hd44780_write_half_byte(bool rs, uint8_t data)
  */
 static void hd44780_write_byte(bool rs, uint8_t data)
 {
-	gpio_clear(hd44780_params.bus->rnw.port, hd44780_params.bus->rnw.gpio);
-
-	if (rs) {
-		gpio_set(hd44780_params.bus->rs.port, hd44780_params.bus->rs.gpio);
-	} else {
-		gpio_clear(hd44780_params.bus->rs.port, hd44780_params.bus->rs.gpio);
-	}
+	hd44780_trace(rs ? HD44780_TRACE_RS : 0, data);
+	hd44780_bus_rs(rs);
 
 	if (data & 0x80)
 		gpio_set(hd44780_params.bus->db7.port, hd44780_params.bus->db7.gpio);
@@ -179,25 +464,380 @@ static void hd44780_write_byte(bool rs, uint8_t data)
 	else
 		gpio_clear(hd44780_params.bus->db0.port, hd44780_params.bus->db0.gpio);
 
-	gpio_set(hd44780_params.bus->e.port, hd44780_params.bus->e.gpio);
-	sleep_ms(1);
-	gpio_clear(hd44780_params.bus->e.port, hd44780_params.bus->e.gpio);
-	sleep_ms(1);
+	hd44780_strobe();
 }
 
 /**
- * @brief Write byte to LCD
+ * @brief Get execution time of transfer
  * @param rs	True if data, otherwise instructin register
  * @param data	Data byte
+ * @return	Execution time, us
  */
-static void hd44780_write(bool rs, uint8_t data)
+static uint32_t hd44780_exec_time(bool rs, uint8_t data)
+{
+	if (rs) {
+		return hd44780_params.timing->exec_us[HD44780_OP_DATA];
+	}
+
+	if (!data) {
+		return HD44780_EXEC_US;
+	}
+
+	return hd44780_params.timing->exec_us[hd44780_instruction_op(data)];
+}
+
+/**
+ * @brief Transfer byte to LCD, controller should be ready
+ * @param rs	True if data, otherwise instructin register
+ * @param data	Data byte
+ */
+static void hd44780_transfer(bool rs, uint8_t data)
 {
 	if (hd44780_params.bus8) {
 		hd44780_write_byte(rs, data);
 	} else {
-		hd44780_write_half_byte(rs, data >> 4);
-		hd44780_write_half_byte(rs, data);
+		// Traced as one transaction
+		hd44780_trace(rs ? HD44780_TRACE_RS : 0, data);
+		hd44780_bus_half_byte(rs, data >> 4);
+		hd44780_bus_half_byte(rs, data);
+	}
+
+	hd44780_params.ready_at = micros() + hd44780_exec_time(rs, data);
+}
+
+/**
+ * @brief Wait for end of previous instruction execution
+ */
+static void hd44780_wait_ready(void)
+{
+	while (TIME_BEFORE(micros(), hd44780_params.ready_at));
+}
+
+/**
+ * @brief Move DDRAM address counter
+ * @param ac	DDRAM address
+ * @param inc	Increment if true, otherwise decrement
+ * @return	Next DDRAM address
+ */
+static uint8_t hd44780_ac_move(uint8_t ac, bool inc)
+{
+	if (hd44780_params.num_lines > 1) {
+		// Two lines: 0x00..0x27 and 0x40..0x67
+		if (inc) {
+			if (ac == 0x27)
+				return 0x40;
+			if (ac == 0x67)
+				return 0x00;
+			return ac + 1;
+		}
+
+		if (ac == 0x00)
+			return 0x67;
+		if (ac == 0x40)
+			return 0x27;
+		return ac - 1;
+	}
+
+	// One line: 0x00..0x4F
+	if (inc) {
+		return (ac == 0x4F) ? 0x00 : ac + 1;
 	}
+
+	return (ac == 0x00) ? 0x4F : ac - 1;
+}
+
+/**
+ * @brief Move display shift
+ * @param left	Shift display left if true, otherwise right
+ */
+static void hd44780_shift_move(bool left)
+{
+	uint8_t span = (hd44780_params.num_lines > 1) ? 40 : 80;
+
+	if (hd44780_params.shift == HD44780_SHIFT_UNKNOWN) {
+		return;
+	}
+
+	if (left) {
+		hd44780_params.shift = (hd44780_params.shift + 1 == span) ? 0 : hd44780_params.shift + 1;
+	} else {
+		hd44780_params.shift = hd44780_params.shift ? hd44780_params.shift - 1 : span - 1;
+	}
+}
+
+/**
+ * @brief Update expected controller state with transfer
+ * @param rs	True if data, otherwise instructin register
+ * @param data	Data byte
+ */
+static void hd44780_track(bool rs, uint8_t data)
+{
+	bool inc = hd44780_params.entry & ENTRY_MODE_ID;
+
+	if (rs) {
+		if (hd44780_params.ac_cgram) {
+			hd44780_params.cgram[hd44780_params.ac] = data;
+			hd44780_params.cgram_known = true;
+			hd44780_params.ac = (hd44780_params.ac + (inc ? 1 : -1)) & CG_RAM_ADDR_MASK;
+		} else {
+			hd44780_params.ddram[hd44780_params.ac] = data;
+			hd44780_params.ac = hd44780_ac_move(hd44780_params.ac, inc);
+			if (hd44780_params.entry & ENTRY_MODE_SH) {
+				hd44780_shift_move(inc);
+			}
+		}
+		return;
+	}
+
+	if (data & SET_DD_RAM_ADDR) {
+		hd44780_params.ac = data & DD_RAM_ADDR_MASK;
+		hd44780_params.ac_cgram = false;
+		hd44780_params.ac_known = true;
+	} else if (data & SET_CG_RAM_ADDR) {
+		hd44780_params.ac = data & CG_RAM_ADDR_MASK;
+		hd44780_params.ac_cgram = true;
+		hd44780_params.ac_known = true;
+	} else if (data & FUNCTION_SET) {
+		hd44780_params.function = data;
+	} else if (data & CURSOR_DISPLAY_SHIFT) {
+		if (data & CURSOR_DISPLAY_SC) {
+			hd44780_shift_move(!(data & CURSOR_DISPLAY_RL));
+		} else if (!hd44780_params.ac_cgram) {
+			hd44780_params.ac = hd44780_ac_move(hd44780_params.ac, data & CURSOR_DISPLAY_RL);
+		}
+	} else if (data & DISPLAY_CONTROL) {
+		hd44780_params.display = data;
+	} else if (data & ENTRY_MODE_SET) {
+		hd44780_params.entry = data;
+	} else if (data & RETURN_HOME) {
+		hd44780_params.ac = 0;
+		hd44780_params.ac_cgram = false;
+		hd44780_params.ac_known = true;
+		hd44780_params.shift = 0;
+	} else if (data & CLEAR_DISPLAY) {
+		memset(hd44780_params.ddram, ' ', HD44780_DDRAM_SIZE);
+		hd44780_params.ac = 0;
+		hd44780_params.ac_cgram = false;
+		hd44780_params.ac_known = true;
+		hd44780_params.shift = 0;
+		hd44780_params.entry |= ENTRY_MODE_ID;
+	}
+}
+
+/**
+ * @brief Get mask of all displays sharing the bus
+ * @return	Displays mask
+ */
+static uint8_t hd44780_group_all(void)
+{
+	if (!hd44780_params.group) {
+		return 0x01;
+	}
+
+	return (0x02 << hd44780_params.group->num) - 1;
+}
+
+/**
+ * @brief Put entry to deferred transfers queue
+ * @param entry	Queue entry
+ */
+static void hd44780_enqueue(uint16_t entry)
+{
+	uint16_t next = (hd44780_params.head + 1) & (HD44780_QUEUE_SIZE - 1);
+
+	// Queue is full - fall back to blocking
+	while (next == hd44780_params.tail) {
+		hd44780_step(micros() + HD44780_EXEC_LONG_US);
+	}
+
+	hd44780_params.queue[hd44780_params.head] = entry;
+	hd44780_params.head = next;
+}
+
+/**
+ * @brief Check if expected controller state is the state of all displays
+ * @return	True if no display of group has missed writes
+ */
+static bool hd44780_state_shared(void)
+{
+	return !hd44780_params.group || !hd44780_params.group->divergent;
+}
+
+/**
+ * @brief Check if instruction doesn't change expected controller state
+ * @param data	Instruction byte
+ * @return	True if instruction may be dropped
+ */
+static bool hd44780_redundant(uint8_t data)
+{
+	if (!data || !hd44780_state_shared()) {
+		return false;
+	}
+
+	switch (hd44780_instruction_op(data)) {
+		case HD44780_OP_HOME:
+			return hd44780_params.ac_known && !hd44780_params.ac_cgram &&
+					!hd44780_params.ac && !hd44780_params.shift;
+
+		case HD44780_OP_ENTRY_MODE:
+			return data == hd44780_params.entry;
+
+		case HD44780_OP_DISPLAY_CTRL:
+			return data == hd44780_params.display;
+
+		case HD44780_OP_CGRAM_ADDR:
+			return hd44780_params.ac_known && hd44780_params.ac_cgram &&
+					hd44780_params.ac == (data & CG_RAM_ADDR_MASK);
+
+		case HD44780_OP_DDRAM_ADDR:
+			return hd44780_params.ac_known && !hd44780_params.ac_cgram &&
+					hd44780_params.ac == (data & DD_RAM_ADDR_MASK);
+
+		default:
+			return false;
+	}
+}
+
+/**
+ * @brief Drop the last queued instruction, if instruction overrides its effect
+ * @param data	Instruction byte
+ * @return	True if instruction cancels the queued one and may be dropped too
+ */
+static bool hd44780_supersede(uint8_t data)
+{
+	uint16_t last;
+	uint8_t op, prev;
+	bool drop;
+
+	if (hd44780_params.head == hd44780_params.tail || !data) {
+		return false;
+	}
+
+	// Data write and display selection are barriers
+	last = hd44780_params.queue[(hd44780_params.head - 1) & (HD44780_QUEUE_SIZE - 1)];
+	if (last & (QUEUE_RS | QUEUE_SELECT) || !(last & 0xFF)) {
+		return false;
+	}
+
+	op = hd44780_instruction_op(data);
+	prev = hd44780_instruction_op(last);
+
+	switch (prev) {
+		// Address counter is set again
+		case HD44780_OP_CGRAM_ADDR:
+		case HD44780_OP_DDRAM_ADDR:
+			drop = op == HD44780_OP_CGRAM_ADDR || op == HD44780_OP_DDRAM_ADDR ||
+					op == HD44780_OP_HOME || op == HD44780_OP_CLEAR;
+			break;
+
+		case HD44780_OP_HOME:
+			drop = op == HD44780_OP_HOME || op == HD44780_OP_CLEAR;
+			break;
+
+		case HD44780_OP_ENTRY_MODE:
+		case HD44780_OP_DISPLAY_CTRL:
+			drop = op == prev;
+			break;
+
+		// Opposite shifts of cursor or display cancel out
+		case HD44780_OP_SHIFT:
+			if (op == prev && (last & CURSOR_DISPLAY_SC) == (data & CURSOR_DISPLAY_SC) &&
+					(last & CURSOR_DISPLAY_RL) != (data & CURSOR_DISPLAY_RL)) {
+				hd44780_params.head = (hd44780_params.head - 1) & (HD44780_QUEUE_SIZE - 1);
+				hd44780_params.elide.merged += 2;
+				return true;
+			}
+			drop = false;
+			break;
+
+		default:
+			drop = false;
+			break;
+	}
+
+	if (drop) {
+		hd44780_params.head = (hd44780_params.head - 1) & (HD44780_QUEUE_SIZE - 1);
+		hd44780_params.elide.merged++;
+	}
+
+	return false;
+}
+
+/**
+ * @brief Write byte to LCD, queue it in deferred mode
+ * @param rs	True if data, otherwise instructin register
+ * @param data	Data byte
+ */
+static void hd44780_write(bool rs, uint8_t data)
+{
+	struct hd44780_group *group = hd44780_params.group;
+
+	if (!rs && hd44780_redundant(data)) {
+		hd44780_params.elide.elided++;
+		return;
+	}
+
+	hd44780_track(rs, data);
+
+	// Displays not selected miss the write
+	if (group) {
+		group->divergent |= hd44780_group_all() & ~group->selected;
+	}
+
+	if (!hd44780_params.deferred) {
+		hd44780_wait_ready();
+		hd44780_transfer(rs, data);
+		return;
+	}
+
+	if (!rs && hd44780_supersede(data)) {
+		return;
+	}
+
+	hd44780_enqueue((rs ? QUEUE_RS : 0) | data);
+}
+
+uint16_t hd44780_step(uint32_t deadline)
+{
+	uint16_t entry;
+
+	while (hd44780_params.tail != hd44780_params.head) {
+		entry = hd44780_params.queue[hd44780_params.tail];
+
+		if (entry & QUEUE_SELECT) {
+			hd44780_select_e(entry);
+			hd44780_params.tail = (hd44780_params.tail + 1) & (HD44780_QUEUE_SIZE - 1);
+			continue;
+		}
+
+		// Controller will be busy up to deadline
+		if (!TIME_BEFORE(hd44780_params.ready_at, deadline)) {
+			break;
+		}
+
+		hd44780_wait_ready();
+
+		hd44780_transfer(entry & QUEUE_RS, entry);
+		hd44780_params.tail = (hd44780_params.tail + 1) & (HD44780_QUEUE_SIZE - 1);
+	}
+
+	return (hd44780_params.head - hd44780_params.tail) & (HD44780_QUEUE_SIZE - 1);
+}
+
+void hd44780_task(void *ctx, uint32_t deadline)
+{
+	(void)ctx;
+
+	hd44780_step(deadline);
+}
+
+void hd44780_set_deferred(bool deferred)
+{
+	if (!deferred) {
+		while (hd44780_step(micros() + HD44780_EXEC_LONG_US));
+	}
+
+	hd44780_params.deferred = deferred;
 }
 
 #ifdef hd44780_DO_CONVERT_RUS
@@ -299,111 +939,363 @@ static void hd44780_gotoxy(uint8_t x, uint8_t y)
 	switch (y) {
 		case 0:
 			y = 0x00;
+			hd44780_params.position.y = 0;
+			break;
+
+		case 1:
+			y = 0x40;
+			hd44780_params.position.y = 1;
+			break;
+
+		default:
+			y = 0x00;
+			x = 0;
+			hd44780_params.position.y = 0;
+			break;
+	}
+
+	hd44780_set_DDRAM_addr(x + y);
+	hd44780_params.position.x = x;
+}
+
+/**
+ * @brief Jump to new line
+ */
+static void hd44780_nl(void)
+{
+	uint8_t y = hd44780_params.position.y + 1;
+	hd44780_gotoxy(0, y);
+}
+
+/**
+ * @brief Switch direction of LCD data lines
+ * @param	input	Data lines are inputs if true, otherwise outputs
+ */
+static void hd44780_data_dir(bool input)
+{
+	uint8_t i;
+
+	for (i = 0; i < hd44780_params.num_data_ports; i++) {
+		gpio_mode_setup(hd44780_params.data_ports[i].port,
+				input ? GPIO_MODE_INPUT : GPIO_MODE_OUTPUT,
+				GPIO_PUPD_PULLUP,
+				hd44780_params.data_ports[i].gpios);
+	}
+}
+
+/**
+ * @brief Strobe E and sample data lines
+ *
+ * Only E of bus is used, so with group of displays data is read from the
+ * first display.
+ *
+ * @return	Data lines, DB7 is bit 7
+ */
+static uint8_t hd44780_read_strobe(void)
+{
+	uint8_t data = 0;
+
+	gpio_set(hd44780_params.bus->e.port, hd44780_params.bus->e.gpio);
+	sleep_us(HD44780_E_PULSE_US);
+
+	if (gpio_get(hd44780_params.bus->db7.port, hd44780_params.bus->db7.gpio))
+		data |= 0x80;
+	if (gpio_get(hd44780_params.bus->db6.port, hd44780_params.bus->db6.gpio))
+		data |= 0x40;
+	if (gpio_get(hd44780_params.bus->db5.port, hd44780_params.bus->db5.gpio))
+		data |= 0x20;
+	if (gpio_get(hd44780_params.bus->db4.port, hd44780_params.bus->db4.gpio))
+		data |= 0x10;
+
+	if (hd44780_params.bus8) {
+		if (gpio_get(hd44780_params.bus->db3.port, hd44780_params.bus->db3.gpio))
+			data |= 0x08;
+		if (gpio_get(hd44780_params.bus->db2.port, hd44780_params.bus->db2.gpio))
+			data |= 0x04;
+		if (gpio_get(hd44780_params.bus->db1.port, hd44780_params.bus->db1.gpio))
+			data |= 0x02;
+		if (gpio_get(hd44780_params.bus->db0.port, hd44780_params.bus->db0.gpio))
+			data |= 0x01;
+	}
+
+	gpio_clear(hd44780_params.bus->e.port, hd44780_params.bus->e.gpio);
+	sleep_us(HD44780_E_PULSE_US);
+
+	return data;
+}
+
+/**
+ * @brief Read byte from LCD, RnW line should be wired
+ * @param rs	True if data, otherwise busy flag and address
+ * @return	Data byte
+ */
+static uint8_t hd44780_read(bool rs)
+{
+	uint8_t data;
+
+	hd44780_data_dir(true);
+
+	gpio_set(hd44780_params.bus->rnw.port, hd44780_params.bus->rnw.gpio);
+
+	hd44780_bus_rs(rs);
+
+	data = hd44780_read_strobe();
+	if (!hd44780_params.bus8) {
+		data |= hd44780_read_strobe() >> 4;
+	}
+
+	gpio_clear(hd44780_params.bus->rnw.port, hd44780_params.bus->rnw.gpio);
+	hd44780_data_dir(false);
+
+	hd44780_trace(HD44780_TRACE_RNW | (rs ? HD44780_TRACE_RS : 0), data);
+
+	if (rs) {
+		// Address counter is updated after data read
+		hd44780_params.ready_at = micros() + hd44780_params.timing->exec_us[HD44780_OP_DATA];
+	}
+
+	return data;
+}
+
+bool hd44780_busy(void)
+{
+	if (!hd44780_params.readable) {
+		return TIME_BEFORE(micros(), hd44780_params.ready_at);
+	}
+
+	return (hd44780_read(false) & FLAGS_BF_MASK);
+}
+
+/**
+ * @brief Perform transfer without tracking, waits for controller
+ * @param rs	True if data, otherwise instructin register
+ * @param data	Data byte
+ */
+static void hd44780_write_now(bool rs, uint8_t data)
+{
+	hd44780_wait_ready();
+	hd44780_transfer(rs, data);
+}
+
+/**
+ * @brief Read DDRAM cell, waits for controller
+ * @param addr	DDRAM address
+ * @return	Cell content
+ */
+static uint8_t hd44780_read_cell(uint8_t addr)
+{
+	hd44780_write_now(false, SET_DD_RAM_ADDR | addr);
+	hd44780_wait_ready();
+
+	return hd44780_read(true);
+}
+
+void hd44780_verify_setup(uint8_t slice, uint32_t period)
+{
+	hd44780_params.verify.slice = slice;
+	hd44780_params.verify.period = period;
+	hd44780_params.verify.next = micros();
+}
+
+uint8_t hd44780_verify_step(uint32_t deadline)
+{
+	// Lines 2 and 3 of 4-lines display continue lines 0 and 1 in DDRAM
+	uint8_t cells = hd44780_params.width * (hd44780_params.num_lines > 2 ? 2 : hd44780_params.num_lines);
+	uint8_t addr;
+	uint8_t i;
+
+	// With group of displays only mirrored content is verified
+	if (!hd44780_params.readable || !cells ||
+			hd44780_params.head != hd44780_params.tail ||
+			(hd44780_params.group && (hd44780_params.group->divergent ||
+				hd44780_params.group->selected != hd44780_group_all())) ||
+			TIME_BEFORE(micros(), hd44780_params.verify.next)) {
+		return 0;
+	}
+
+	hd44780_params.verify.next = micros() + hd44780_params.verify.period;
+
+	for (i = 0; i < hd44780_params.verify.slice; i++) {
+		// Worst case: address, read, address, write, address, read
+		if (!TIME_BEFORE(micros() + 3 * (hd44780_params.timing->exec_us[HD44780_OP_DDRAM_ADDR] +
+				hd44780_params.timing->exec_us[HD44780_OP_DATA]), deadline)) {
 			break;
+		}
+
+		if (hd44780_params.verify.pos >= cells) {
+			hd44780_params.verify.pos = 0;
+		}
+
+		addr = hd44780_params.verify.pos % hd44780_params.width;
+		if (hd44780_params.verify.pos >= hd44780_params.width) {
+			addr += 0x40;
+		}
+		hd44780_params.verify.pos++;
+
+		hd44780_params.verify.stats.checked++;
+		if (hd44780_read_cell(addr) == hd44780_params.ddram[addr]) {
+			continue;
+		}
+
+		hd44780_params.verify.stats.detected++;
+
+		// Data write would shift the display
+		if (hd44780_params.entry & ENTRY_MODE_SH) {
+			continue;
+		}
+
+		hd44780_write_now(false, SET_DD_RAM_ADDR | addr);
+		hd44780_write_now(true, hd44780_params.ddram[addr]);
+
+		if (hd44780_read_cell(addr) == hd44780_params.ddram[addr]) {
+			hd44780_params.verify.stats.corrected++;
+		}
+	}
 
-		case 1:
-			y = 0x40;
-			hd44780_params.position.y = 1;
-			break;
+	// Nothing was read, so address counter is intact
+	if (!i) {
+		return 0;
+	}
 
-		default:
-			y = 0x00;
-			x = 0;
-			hd44780_params.position.y = 0;
-			break;
+	// Restore address counter
+	if (hd44780_params.ac_cgram) {
+		hd44780_write_now(false, SET_CG_RAM_ADDR | hd44780_params.ac);
+	} else {
+		hd44780_write_now(false, SET_DD_RAM_ADDR | hd44780_params.ac);
 	}
 
-	hd44780_set_DDRAM_addr(x + y);
-	hd44780_params.position.x = x;
+	return i;
 }
 
-/**
- * @brief Jump to new line
- */
-static void hd44780_nl(void)
+void hd44780_verify_task(void *ctx, uint32_t deadline)
 {
-	uint8_t y = hd44780_params.position.y + 1;
-	hd44780_gotoxy(0, y);
+	(void)ctx;
+
+	hd44780_verify_step(deadline);
 }
 
-#warning XXX: hd44780_read yet not implmented!
-#if 0
-static uint8_t hd44780_read_byte(bool rs)
+const struct hd44780_verify_stats *hd44780_verify_get_stats(void)
 {
-	uint8_t temp = 0;
-
-	gpio_set(hd44780_params.bus->rnw.port, hd44780_params.bus->rnw.gpio);
+	return &hd44780_params.verify.stats;
+}
 
-	if (rs) {
-		gpio_set(hd44780_params.bus->rs.port, hd44780_params.bus->rs.gpio);
-	} else {
-		gpio_clear(hd44780_params.bus->rs.port, hd44780_params.bus->rs.gpio);
-	}
+const struct hd44780_elide_stats *hd44780_elide_get_stats(void)
+{
+	return &hd44780_params.elide;
+}
 
-	gpio_set(hd44780_params.bus->e.port, hd44780_params.bus->e.gpio);
-	sleep_ms(1);
+/**
+ * @brief Measure execution time of instruction or data write by busy flag
+ * @param rs	True if data, otherwise instructin register
+ * @param data	Data byte
+ * @return	Execution time, us, or 0 on timeout
+ */
+static uint32_t hd44780_measure(bool rs, uint8_t data)
+{
+	uint32_t start;
 
-	// XXX: Get data from LCD here
+	hd44780_transfer(rs, data);
+	start = micros();
 
-	gpio_clear(hd44780_params.bus->e.port, hd44780_params.bus->e.gpio);
-	sleep_ms(1);
+	// Time of busy flag read is included, so result is never optimistic
+	while (hd44780_read(false) & FLAGS_BF_MASK) {
+		if (!TIME_BEFORE(micros(), start + HD44780_CALIBRATE_TIMEOUT_US)) {
+			return 0;
+		}
+	}
 
-	return temp;
+	return micros() - start;
 }
 
-static uint8_t hd44780_read_half_byte(bool rs)
+bool hd44780_calibrate(struct hd44780_timing *timing, uint8_t margin)
 {
-	uint8_t temp = 0;
-
-	gpio_set(hd44780_params.bus->rnw.port, hd44780_params.bus->rnw.gpio);
-
-	if (rs) {
-		gpio_set(hd44780_params.bus->rs.port, hd44780_params.bus->rs.gpio);
-	} else {
-		gpio_clear(hd44780_params.bus->rs.port, hd44780_params.bus->rs.gpio);
+	// Instructions which don't change configuration, in order of execution
+	const uint8_t probes[HD44780_OP_DATA + 1] = {
+		[HD44780_OP_CLEAR] = CLEAR_DISPLAY,
+		[HD44780_OP_HOME] = RETURN_HOME,
+		[HD44780_OP_ENTRY_MODE] = hd44780_params.entry,
+		[HD44780_OP_DISPLAY_CTRL] = hd44780_params.display,
+		[HD44780_OP_SHIFT] = CURSOR_DISPLAY_SHIFT | CURSOR_DISPLAY_RL,
+		[HD44780_OP_FUNCTION_SET] = hd44780_params.function,
+		[HD44780_OP_CGRAM_ADDR] = SET_CG_RAM_ADDR,
+		[HD44780_OP_DDRAM_ADDR] = SET_DD_RAM_ADDR,
+		[HD44780_OP_DATA] = ' ',
+	};
+	uint32_t max[HD44780_OP_DATA + 1] = {0};
+	bool deferred = hd44780_params.deferred;
+	bool ok = true;
+	uint32_t elapsed;
+	uint8_t run, op;
+
+	if (!hd44780_params.readable) {
+		return false;
 	}
 
-	gpio_set(hd44780_params.bus->e.port, hd44780_params.bus->e.gpio);
-	sleep_ms(1);
+	hd44780_set_deferred(false);
+	hd44780_wait_ready();
 
-	// XXX: Get HIGH part of data from LCD here
+	for (run = 0; ok && run < HD44780_CALIBRATE_RUNS; run++) {
+		for (op = 0; op <= HD44780_OP_DATA; op++) {
+			elapsed = hd44780_measure(op == HD44780_OP_DATA, probes[op]);
+			if (!elapsed) {
+				ok = false;
+				break;
+			}
 
-	gpio_clear(hd44780_params.bus->e.port, hd44780_params.bus->e.gpio);
-	gpio_set(hd44780_params.bus->e.port, hd44780_params.bus->e.gpio);
-	sleep_ms(1);
+			if (elapsed > max[op]) {
+				max[op] = elapsed;
+			}
+		}
+	}
 
-	// XXX: Get LOW part of data from LCD here
+	if (ok) {
+		for (op = 0; op <= HD44780_OP_DATA; op++) {
+			timing->exec_us[op] = (max[op] * (100 + margin) + 99) / 100;
+		}
+		hd44780_params.ready_at = micros();
+	} else {
+		// Controller may still be executing the probe
+		hd44780_params.ready_at = micros() + HD44780_EXEC_LONG_US;
+	}
 
-	gpio_clear(hd44780_params.bus->e.port, hd44780_params.bus->e.gpio);
-	sleep_ms(1);
+	// Probes aren't tracked, mirror follows controller again
+	hd44780_clear();
+	hd44780_set_deferred(deferred);
 
-	return temp;
+	return ok;
 }
 
-static uint8_t hd44780_read_half_byte(bool rs)
+void hd44780_set_timing(const struct hd44780_timing *timing)
 {
-	uint8_t data;
-
-	if (hd44780_params.bus8) {
-		data = hd44780_read(rs);
-	} else {
-		data = hd44780_read(rs, data) << 4;
-		data |= hd44780_read(rs);
-	}
+	hd44780_params.timing = timing ? timing : &hd44780_timing_datasheet;
+}
 
-	return data;
+/**
+ * @brief Check if signature can be read back and its cells are out of
+ * visible area, write-only bus never uses it
+ * @return	True if signature can be used
+ */
+static bool hd44780_signature_hidden(void)
+{
+	// Lines 2 and 3 of 4-lines display continue lines 0 and 1 in DDRAM
+	return hd44780_params.readable && hd44780_params.num_lines <= 2 &&
+			hd44780_params.width <= HD44780_SIGNATURE_ADDR;
 }
-#endif
 
-#warning XXX: hd44780_busy yet not implmented!
-bool hd44780_busy(void)
+/**
+ * @brief Write warm restart signature and return to address 0
+ */
+static void hd44780_write_signature(void)
 {
-#if 0
-    return (hd44780_read(false) & FLAGS_BF_MASK);
-#else
-	sleep_ms(1);
-	return true;
-#endif
+	// Data write would shift the display
+	if (!hd44780_signature_hidden() || (hd44780_params.entry & ENTRY_MODE_SH)) {
+		return;
+	}
+
+	hd44780_set_DDRAM_addr(HD44780_SIGNATURE_ADDR);
+	hd44780_write(true, HD44780_SIGNATURE_0);
+	hd44780_write(true, HD44780_SIGNATURE_1);
+	hd44780_set_DDRAM_addr(0);
 }
 
 void hd44780_clear()
@@ -412,6 +1304,7 @@ void hd44780_clear()
 	hd44780_params.position.y = 0;
 
 	hd44780_write(false, CLEAR_DISPLAY);
+	hd44780_write_signature();
 }
 
 void hd44780_home()
@@ -419,8 +1312,15 @@ void hd44780_home()
 	hd44780_params.position.x = 0;
 	hd44780_params.position.y = 0;
 
+	// Display isn't shifted, so address set is equivalent and much faster
+	if (hd44780_state_shared() && !hd44780_params.shift &&
+			hd44780_params.ac_known && (hd44780_params.ac || hd44780_params.ac_cgram)) {
+		hd44780_params.elide.shortened++;
+		hd44780_write(false, SET_DD_RAM_ADDR);
+		return;
+	}
+
 	hd44780_write(false, RETURN_HOME);
-	sleep_ms(2);
 }
 
 void hd44780_mode(bool inc, bool shift)
@@ -523,77 +1423,271 @@ static void hd44780_init_4bits(void)
 	hd44780_write_half_byte(false, FUNCTION_SET >> 4);
 }
 
-void hd44780_init(struct hd44780_bus *bus_props, uint8_t width, bool bus8, uint8_t num_lines, bool big_fonts)
+/**
+ * @brief Claim GPIO of LCD bus line as output, low by default
+ * @param	line	GPIO of LCD bus line
+ * @return	GPIO_RES_OK or negative error code
+ */
+static int hd44780_claim(struct hd44780_gpio *line)
 {
-    hd44780_params.width = width;
-    hd44780_params.position.x = 0;
-    hd44780_params.position.y = 0;
-	hd44780_params.bus8 = bus8;
-	hd44780_params.bus = bus_props;
+	return gpio_res_claim(line->port, line->gpio, GPIO_MODE_OUTPUT, GPIO_PUPD_PULLUP, false, GPIO_RES_OWNER_HD44780);
+}
 
-	// Configuring GPIO used for LCD bus
-	rcc_periph_clock_enable(port2RCC(bus_props->rs.port));
-	gpio_clear(bus_props->rs.port, bus_props->rs.gpio);
-	gpio_mode_setup(bus_props->rs.port, GPIO_MODE_OUTPUT, GPIO_PUPD_PULLUP, bus_props->rs.gpio);
+/**
+ * @brief Configure GPIO of LCD bus and reset driver state
+ * @param	bus_props	Data bus GPIO descriptor
+ * @param	width		Display width
+ * @param	bus8		8-bits long bus
+ * @param	num_lines	Number of display lines
+ * @return	GPIO_RES_OK or negative error code
+ */
+static int hd44780_setup(struct hd44780_bus *bus_props, uint8_t width, bool bus8, uint8_t num_lines)
+{
+	struct hd44780_gpio *lines[] = {
+		&bus_props->rs, &bus_props->e, &bus_props->rnw,
+		&bus_props->db7, &bus_props->db6, &bus_props->db5, &bus_props->db4,
+		&bus_props->db3, &bus_props->db2, &bus_props->db1, &bus_props->db0,
+	};
+	uint8_t num = bus8 ? 11 : 7;
+	uint8_t i, j;
+	int ret;
+
+	hd44780_params.num_data_ports = 0;
+
+	// Re-init claims the same pins again
+	gpio_res_release_owner(GPIO_RES_OWNER_HD44780);
+
+	// Configuring GPIO used for LCD bus, batched per port
+	for (i = 0; i < num; i++) {
+		// RnW may be tied to ground
+		if (lines[i] == &bus_props->rnw && !bus_props->rnw.port) {
+			continue;
+		}
 
-	rcc_periph_clock_enable(port2RCC(bus_props->e.port));
-	gpio_clear(bus_props->e.port, bus_props->e.gpio);
-	gpio_mode_setup(bus_props->e.port, GPIO_MODE_OUTPUT, GPIO_PUPD_PULLUP, bus_props->e.gpio);
+		ret = hd44780_claim(lines[i]);
+		if (ret < 0) {
+			gpio_res_abort();
+			return ret;
+		}
 
-	rcc_periph_clock_enable(port2RCC(bus_props->rnw.port));
-	gpio_clear(bus_props->rnw.port, bus_props->rnw.gpio);
-	gpio_mode_setup(bus_props->rnw.port, GPIO_MODE_OUTPUT, GPIO_PUPD_PULLUP, bus_props->rnw.gpio);
+		// Group data lines per port for switching direction
+		if (i < 3) {
+			continue;
+		}
 
-	rcc_periph_clock_enable(port2RCC(bus_props->db7.port));
-	gpio_clear(bus_props->db7.port, bus_props->db7.gpio);
-	gpio_mode_setup(bus_props->db7.port, GPIO_MODE_OUTPUT, GPIO_PUPD_PULLUP, bus_props->db7.gpio);
+		for (j = 0; j < hd44780_params.num_data_ports; j++) {
+			if (hd44780_params.data_ports[j].port == lines[i]->port) {
+				break;
+			}
+		}
 
-	rcc_periph_clock_enable(port2RCC(bus_props->db6.port));
-	gpio_clear(bus_props->db6.port, bus_props->db6.gpio);
-	gpio_mode_setup(bus_props->db6.port, GPIO_MODE_OUTPUT, GPIO_PUPD_PULLUP, bus_props->db6.gpio);
+		if (j == hd44780_params.num_data_ports) {
+			hd44780_params.data_ports[j].port = lines[i]->port;
+			hd44780_params.data_ports[j].gpios = 0;
+			hd44780_params.num_data_ports++;
+		}
 
-	rcc_periph_clock_enable(port2RCC(bus_props->db5.port));
-	gpio_clear(bus_props->db5.port, bus_props->db5.gpio);
-	gpio_mode_setup(bus_props->db5.port, GPIO_MODE_OUTPUT, GPIO_PUPD_PULLUP, bus_props->db5.gpio);
+		hd44780_params.data_ports[j].gpios |= lines[i]->gpio;
+	}
 
-	rcc_periph_clock_enable(port2RCC(bus_props->db4.port));
-	gpio_clear(bus_props->db4.port, bus_props->db4.gpio);
-	gpio_mode_setup(bus_props->db4.port, GPIO_MODE_OUTPUT, GPIO_PUPD_PULLUP, bus_props->db4.gpio);
+	for (i = 0; hd44780_params.group && i < hd44780_params.group->num; i++) {
+		ret = hd44780_claim(&hd44780_params.group->e[i]);
+		if (ret < 0) {
+			gpio_res_abort();
+			return ret;
+		}
+	}
 
-	if (bus8) {
-		rcc_periph_clock_enable(port2RCC(bus_props->db3.port));
-		gpio_clear(bus_props->db3.port, bus_props->db3.gpio);
-		gpio_mode_setup(bus_props->db3.port, GPIO_MODE_OUTPUT, GPIO_PUPD_PULLUP, bus_props->db3.gpio);
+	gpio_res_commit();
 
-		rcc_periph_clock_enable(port2RCC(bus_props->db2.port));
-		gpio_clear(bus_props->db2.port, bus_props->db2.gpio);
-		gpio_mode_setup(bus_props->db2.port, GPIO_MODE_OUTPUT, GPIO_PUPD_PULLUP, bus_props->db2.gpio);
+	hd44780_params.width = width;
+	hd44780_params.num_lines = num_lines;
+	hd44780_params.position.x = 0;
+	hd44780_params.position.y = 0;
+	hd44780_params.bus8 = bus8;
+	hd44780_params.readable = bus_props->rnw.port != 0;
+	hd44780_params.rs_level = HD44780_RS_UNKNOWN;
+	hd44780_params.bus = bus_props;
+	hd44780_params.deferred = false;
+	hd44780_params.head = 0;
+	hd44780_params.tail = 0;
+	// Controller state is unknown until written
+	hd44780_params.entry = ENTRY_MODE_ID;
+	hd44780_params.display = 0;
+	hd44780_params.function = 0;
+	hd44780_params.ac_known = false;
+	hd44780_params.cgram_known = false;
+	hd44780_params.shift = HD44780_SHIFT_UNKNOWN;
+	memset(&hd44780_params.elide, 0, sizeof(hd44780_params.elide));
+	hd44780_verify_setup(HD44780_VERIFY_SLICE, HD44780_VERIFY_PERIOD_US);
+
+	// All displays are initialized together
+	if (hd44780_params.group) {
+		hd44780_params.group->selected = hd44780_group_all();
+		hd44780_params.group->divergent = 0;
+	}
+	hd44780_select_e(hd44780_group_all());
 
-		rcc_periph_clock_enable(port2RCC(bus_props->db1.port));
-		gpio_clear(bus_props->db1.port, bus_props->db1.gpio);
-		gpio_mode_setup(bus_props->db1.port, GPIO_MODE_OUTPUT, GPIO_PUPD_PULLUP, bus_props->db1.gpio);
+	hd44780_params.ready_at = micros();
 
-		rcc_periph_clock_enable(port2RCC(bus_props->db0.port));
-		gpio_clear(bus_props->db0.port, bus_props->db0.gpio);
-		gpio_mode_setup(bus_props->db0.port, GPIO_MODE_OUTPUT, GPIO_PUPD_PULLUP, bus_props->db0.gpio);
-	}
+	return GPIO_RES_OK;
+}
+
+/**
+ * @brief Apply default configuration
+ * @param	bus8		8-bits long bus
+ * @param	num_lines	Number of display lines
+ * @param	big_fonts	5x10 dots fonts if true, otherwise 5x8
+ */
+static void hd44780_configure(bool bus8, uint8_t num_lines, bool big_fonts)
+{
+	hd44780_fnc(bus8, num_lines, big_fonts);
+	hd44780_dispay_ctrl(true, false, false);
+	hd44780_mode(true, false);
+	hd44780_cursor_ctrl(false, false);
+}
 
+/**
+ * @brief Full power-on initialization sequence
+ * @param	bus8		8-bits long bus
+ * @param	num_lines	Number of display lines
+ * @param	big_fonts	5x10 dots fonts if true, otherwise 5x8
+ */
+static void hd44780_cold_start(bool bus8, uint8_t num_lines, bool big_fonts)
+{
 	sleep_ms(40);
 
 	if (!bus8) {
 		hd44780_init_4bits();
 	}
 
-	// Apply default configuration
-	hd44780_fnc(false, num_lines, false);
-	hd44780_dispay_ctrl(true, false, false);
-	hd44780_mode(true, false);
-	hd44780_cursor_ctrl(false, false);
+	hd44780_params.ready_at = micros() + HD44780_EXEC_US;
+
+	hd44780_configure(bus8, num_lines, big_fonts);
 
 	hd44780_clear();
 	hd44780_home();
 }
 
+/**
+ * @brief Resynchronize with live controller, e.g. after MCU reset in the
+ * middle of 4-bits transfer
+ *
+ * The same sequence as on power-on, but with instruction execution times
+ * instead of power-on delays. The first write may complete a byte started
+ * before reset, so it's given the longest execution time.
+ */
+static void hd44780_resync(void)
+{
+	if (hd44780_params.bus8) {
+		hd44780_write_byte(false, FUNCTION_SET | FUNCTION_SET_DL);
+		sleep_us(HD44780_EXEC_LONG_US);
+		hd44780_write_byte(false, FUNCTION_SET | FUNCTION_SET_DL);
+		sleep_us(HD44780_EXEC_US);
+		hd44780_write_byte(false, FUNCTION_SET | FUNCTION_SET_DL);
+		sleep_us(HD44780_EXEC_US);
+	} else {
+		hd44780_write_half_byte(false, (FUNCTION_SET | FUNCTION_SET_DL) >> 4);
+		sleep_us(HD44780_EXEC_LONG_US);
+		hd44780_write_half_byte(false, (FUNCTION_SET | FUNCTION_SET_DL) >> 4);
+		sleep_us(HD44780_EXEC_US);
+		hd44780_write_half_byte(false, (FUNCTION_SET | FUNCTION_SET_DL) >> 4);
+		sleep_us(HD44780_EXEC_US);
+		hd44780_write_half_byte(false, FUNCTION_SET >> 4);
+		sleep_us(HD44780_EXEC_US);
+	}
+
+	hd44780_params.ready_at = micros();
+}
+
+/**
+ * @brief Detect live and configured controller
+ * @return	True if controller is idle and keeps signature
+ */
+static bool hd44780_detect(void)
+{
+	if (!hd44780_params.readable || !hd44780_signature_hidden()) {
+		return false;
+	}
+
+	hd44780_resync();
+
+	// Controller is still in internal reset after power-on
+	if (hd44780_read(false) & FLAGS_BF_MASK) {
+		return false;
+	}
+
+	return hd44780_read_cell(HD44780_SIGNATURE_ADDR) == HD44780_SIGNATURE_0 &&
+			hd44780_read_cell(HD44780_SIGNATURE_ADDR + 1) == HD44780_SIGNATURE_1;
+}
+
+/**
+ * @brief Restore driver state from live controller
+ */
+static void hd44780_restore(void)
+{
+	uint8_t addr;
+	uint8_t x, y;
+
+	memset(hd44780_params.ddram, ' ', HD44780_DDRAM_SIZE);
+	hd44780_params.ddram[HD44780_SIGNATURE_ADDR] = HD44780_SIGNATURE_0;
+	hd44780_params.ddram[HD44780_SIGNATURE_ADDR + 1] = HD44780_SIGNATURE_1;
+
+	// Entry mode is incrementing, so every line is read by one address set
+	for (y = 0; y < hd44780_params.num_lines && y < 2; y++) {
+		addr = y ? 0x40 : 0x00;
+		hd44780_write_now(false, SET_DD_RAM_ADDR | addr);
+
+		for (x = 0; x < hd44780_params.width; x++) {
+			hd44780_wait_ready();
+			hd44780_params.ddram[addr + x] = hd44780_read(true);
+		}
+	}
+
+	// Custom characters are kept as well
+	hd44780_write_now(false, SET_CG_RAM_ADDR);
+	for (addr = 0; addr < HD44780_CGRAM_SIZE; addr++) {
+		hd44780_wait_ready();
+		hd44780_params.cgram[addr] = hd44780_read(true);
+	}
+	hd44780_params.cgram_known = true;
+
+	// Reset display shift and address counter
+	hd44780_home();
+}
+
+int hd44780_init(struct hd44780_bus *bus_props, uint8_t width, bool bus8, uint8_t num_lines, bool big_fonts)
+{
+	int ret = hd44780_setup(bus_props, width, bus8, num_lines);
+
+	if (ret < 0) {
+		return ret;
+	}
+
+	hd44780_cold_start(bus8, num_lines, big_fonts);
+
+	return GPIO_RES_OK;
+}
+
+int hd44780_init_fast(struct hd44780_bus *bus_props, uint8_t width, bool bus8, uint8_t num_lines, bool big_fonts)
+{
+	int ret = hd44780_setup(bus_props, width, bus8, num_lines);
+
+	if (ret < 0) {
+		return ret;
+	}
+
+	if (!hd44780_detect()) {
+		hd44780_cold_start(bus8, num_lines, big_fonts);
+		return GPIO_RES_OK;
+	}
+
+	hd44780_configure(bus8, num_lines, big_fonts);
+	hd44780_restore();
+
+	return HD44780_WARM_START;
+}
+
 void hd44780_putchar(int ch)
 {
 #ifdef hd44780_DO_CONVERT
@@ -610,6 +1704,80 @@ void hd44780_putchar_xy(uint8_t x, uint8_t y, int ch)
 	hd44780_putchar(ch);
 }
 
+/**
+ * @brief Set printing position from address counter
+ */
+static void hd44780_sync_position(void)
+{
+	if (!hd44780_params.ac_cgram) {
+		hd44780_params.position.y = hd44780_params.ac >= 0x40;
+		hd44780_params.position.x = hd44780_params.ac & 0x3F;
+	}
+}
+
+void hd44780_update(uint8_t x, uint8_t y, const uint8_t *data, uint8_t len)
+{
+	uint8_t base = y ? 0x40 : 0x00;
+	bool stream = (hd44780_params.entry & (ENTRY_MODE_ID | ENTRY_MODE_SH)) == ENTRY_MODE_ID;
+	uint8_t addr;
+	uint8_t i;
+
+	if (y >= hd44780_params.num_lines || y > 1 || x >= hd44780_params.width) {
+		return;
+	}
+
+	if (len > hd44780_params.width - x) {
+		len = hd44780_params.width - x;
+	}
+
+	for (i = 0; i < len; i++) {
+		addr = base + x + i;
+
+		if (hd44780_params.ddram[addr] == data[i]) {
+			continue;
+		}
+
+		// Address is set only if the cell isn't next to the previous one
+		if (!stream || hd44780_params.ac_cgram || hd44780_params.ac != addr) {
+			hd44780_set_DDRAM_addr(addr);
+		}
+
+		hd44780_write(true, data[i]);
+	}
+
+	hd44780_sync_position();
+}
+
+/**
+ * @brief Write data to CG or DD RAM from current address
+ * @param data	Data bytes
+ * @param len	Number of bytes
+ */
+static void hd44780_write_data(const uint8_t *data, size_t len)
+{
+	size_t i;
+
+	for (i = 0; i < len; i++) {
+		hd44780_write(true, data[i]);
+	}
+}
+
+void hd44780_write_block(uint8_t x, uint8_t y, const uint8_t *data, size_t len)
+{
+	hd44780_gotoxy(x, y);
+	hd44780_write_data(data, len);
+	hd44780_sync_position();
+}
+
+void hd44780_write_cgram_block(uint8_t addr, const uint8_t *data, size_t len)
+{
+	hd44780_set_CGRAM_addr(addr);
+	hd44780_write_data(data, len);
+
+	// Return to printing position
+	hd44780_gotoxy(hd44780_params.position.x, hd44780_params.position.y);
+}
+
 static int hd44780_vsprintf(const char *fmt, va_list arg_ptr)
 {
 	char buf[HD44780_MAX_BUFFER_SIZE];
@@ -651,9 +1819,125 @@ void hd44780_printf_xy(uint8_t x, uint8_t y, const char *fmt, ...)
 
 void hd44780_define_char(uint8_t addr, uint8_t* pattern, uint8_t size)
 {
-	uint8_t i;
-	hd44780_write(false, addr);
-	for(i = 0; i < size; i++){
-		hd44780_write(true, pattern[i]);
+	hd44780_write_cgram_block(addr, pattern, size);
+}
+
+void hd44780_group_attach(struct hd44780_group *group)
+{
+	hd44780_params.group = group;
+}
+
+void hd44780_group_select(uint8_t mask)
+{
+	struct hd44780_group *group = hd44780_params.group;
+
+	if (!group) {
+		return;
+	}
+
+	group->selected = mask & hd44780_group_all();
+
+	if (hd44780_params.deferred) {
+		hd44780_enqueue(QUEUE_SELECT | group->selected);
+	} else {
+		hd44780_select_e(group->selected);
+	}
+}
+
+uint8_t hd44780_group_divergent(void)
+{
+	if (!hd44780_params.group) {
+		return 0;
+	}
+
+	return hd44780_params.group->divergent;
+}
+
+void hd44780_group_resync(void)
+{
+	struct hd44780_group *group = hd44780_params.group;
+	uint8_t ac = hd44780_params.ac;
+	bool ac_cgram = hd44780_params.ac_cgram;
+	uint8_t entry = hd44780_params.entry;
+	uint8_t shift = hd44780_params.shift;
+	uint8_t y;
+
+	if (!group || !group->divergent) {
+		return;
+	}
+
+	// Nothing is elided while displays are divergent
+	hd44780_group_select(group->divergent);
+
+	if (hd44780_params.function) {
+		hd44780_write(false, hd44780_params.function);
+	}
+	if (hd44780_params.display) {
+		hd44780_write(false, hd44780_params.display);
+	}
+
+	// Copy runs forward and doesn't shift the display
+	hd44780_write(false, ENTRY_MODE_SET | ENTRY_MODE_ID);
+
+	// Unknown CGRAM would erase custom characters of divergent displays
+	if (hd44780_params.cgram_known) {
+		hd44780_write(false, SET_CG_RAM_ADDR);
+		hd44780_write_data(hd44780_params.cgram, HD44780_CGRAM_SIZE);
+	}
+
+	for (y = 0; y < hd44780_params.num_lines && y < 2; y++) {
+		hd44780_write(false, SET_DD_RAM_ADDR | (y ? 0x40 : 0x00));
+		hd44780_write_data(&hd44780_params.ddram[y ? 0x40 : 0x00], hd44780_params.width);
+	}
+
+	if (shift != HD44780_SHIFT_UNKNOWN) {
+		hd44780_write(false, RETURN_HOME);
+		while (hd44780_params.shift != shift) {
+			hd44780_write(false, CURSOR_DISPLAY_SHIFT | CURSOR_DISPLAY_SC);
+		}
+	}
+
+	if (entry & ENTRY_MODE_SET) {
+		hd44780_write(false, entry);
+	}
+
+	// Restore address counter of all displays
+	hd44780_group_select(hd44780_group_all());
+	if (ac_cgram) {
+		hd44780_write(false, SET_CG_RAM_ADDR | ac);
+	} else {
+		hd44780_write(false, SET_DD_RAM_ADDR | ac);
+	}
+
+	group->divergent = 0;
+}
+
+#ifdef HD44780_TRACE
+const struct hd44780_trace_entry *hd44780_trace_get(uint32_t *head)
+{
+	*head = hd44780_trace_ring.head;
+
+	return hd44780_trace_ring.entries;
+}
+
+void hd44780_trace_dump(void (*put_line)(const char *line))
+{
+	const struct hd44780_trace_entry *entry;
+	char line[40];
+	uint32_t head = hd44780_trace_ring.head;
+	uint32_t i = 0;
+
+	// Only the last HD44780_TRACE_SIZE entries are kept
+	if (head > HD44780_TRACE_SIZE) {
+		i = head - HD44780_TRACE_SIZE;
+	}
+
+	for (; i < head; i++) {
+		entry = &hd44780_trace_ring.entries[i & (HD44780_TRACE_SIZE - 1)];
+		snprintf(line, sizeof(line), "T %08lx %02x %02x %02x %02x\n",
+				(unsigned long)entry->timestamp, entry->flags, entry->data,
+				entry->op, entry->displays);
+		put_line(line);
 	}
 }
+#endif
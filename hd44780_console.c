@@ -0,0 +1,233 @@
+/**
+ * Copyright (C) 2019, Sergey Shcherbakov
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Std headers
+#include <string.h>
+
+// Local headers
+#include "include/hd44780_console.h"
+
+#define ESC 0x1B
+
+/* Parser states */
+#define CONSOLE_NORMAL  0
+#define CONSOLE_ESC     1
+#define CONSOLE_CSI     2
+
+/**
+ * @brief Fill part of screen line with spaces
+ * @param	scr		Screen
+ * @param	y		Line
+ * @param	from	First column
+ * @param	to		Column after the last one
+ */
+static void hd44780_console_erase(struct hd44780_screen *scr, uint8_t y, uint8_t from, uint8_t to)
+{
+	if (to > scr->width) {
+		to = scr->width;
+	}
+
+	if (from < to) {
+		memset(&scr->cells[y][from], ' ', to - from);
+		scr->dirty |= 1u << y;
+	}
+}
+
+/**
+ * @brief Jump to new line, scroll screen up at the bottom
+ * @param	scr	Screen
+ */
+static void hd44780_console_nl(struct hd44780_screen *scr)
+{
+	scr->x = 0;
+
+	if (scr->y + 1 < scr->num_lines) {
+		scr->y++;
+		return;
+	}
+
+	memmove(scr->cells[0], scr->cells[1], (scr->num_lines - 1) * sizeof(scr->cells[0]));
+	hd44780_console_erase(scr, scr->num_lines - 1, 0, scr->width);
+	scr->dirty = (1u << scr->num_lines) - 1;
+}
+
+/**
+ * @brief Put printable character at cursor
+ * @param	scr	Screen
+ * @param	ch	Character
+ */
+static void hd44780_console_print(struct hd44780_screen *scr, uint8_t ch)
+{
+	if (scr->x >= scr->width) {
+		hd44780_console_nl(scr);
+	}
+
+	if (scr->cells[scr->y][scr->x] != ch) {
+		scr->cells[scr->y][scr->x] = ch;
+		scr->dirty |= 1u << scr->y;
+	}
+
+	scr->x++;
+}
+
+/**
+ * @brief Execute control sequence
+ * @param	con	Console
+ * @param	cmd	Final byte of sequence
+ */
+static void hd44780_console_csi(struct hd44780_console *con, uint8_t cmd)
+{
+	struct hd44780_screen *scr = con->scr;
+	uint8_t n = con->params[0] ? con->params[0] : 1;
+	uint8_t y;
+
+	switch (cmd) {
+		case 'H':
+		case 'f':
+			y = con->params[0] ? con->params[0] - 1 : 0;
+			scr->x = con->params[1] ? con->params[1] - 1 : 0;
+			scr->y = (y < scr->num_lines) ? y : scr->num_lines - 1;
+			if (scr->x > scr->width - 1) {
+				scr->x = scr->width - 1;
+			}
+			break;
+
+		case 'A':
+			scr->y = (scr->y > n) ? scr->y - n : 0;
+			break;
+
+		case 'B':
+			scr->y = (scr->y + n < scr->num_lines) ? scr->y + n : scr->num_lines - 1;
+			break;
+
+		case 'C':
+			scr->x = (scr->x + n < scr->width) ? scr->x + n : scr->width - 1;
+			break;
+
+		case 'D':
+			scr->x = (scr->x > n) ? scr->x - n : 0;
+			break;
+
+		case 'K':
+			if (con->params[0] == 0) {
+				hd44780_console_erase(scr, scr->y, scr->x, scr->width);
+			} else if (con->params[0] == 1) {
+				hd44780_console_erase(scr, scr->y, 0, scr->x + 1);
+			} else if (con->params[0] == 2) {
+				hd44780_console_erase(scr, scr->y, 0, scr->width);
+			}
+			break;
+
+		case 'J':
+			if (con->params[0] == 0) {
+				hd44780_console_erase(scr, scr->y, scr->x, scr->width);
+				for (y = scr->y + 1; y < scr->num_lines; y++) {
+					hd44780_console_erase(scr, y, 0, scr->width);
+				}
+			} else if (con->params[0] == 1) {
+				for (y = 0; y < scr->y; y++) {
+					hd44780_console_erase(scr, y, 0, scr->width);
+				}
+				hd44780_console_erase(scr, scr->y, 0, scr->x + 1);
+			} else if (con->params[0] == 2) {
+				for (y = 0; y < scr->num_lines; y++) {
+					hd44780_console_erase(scr, y, 0, scr->width);
+				}
+			}
+			break;
+
+		default:
+			break;
+	}
+}
+
+void hd44780_console_init(struct hd44780_console *con, struct hd44780_screen *scr)
+{
+	con->scr = scr;
+	con->state = CONSOLE_NORMAL;
+}
+
+void hd44780_console_putc(struct hd44780_console *con, uint8_t ch)
+{
+	struct hd44780_screen *scr = con->scr;
+
+	switch (con->state) {
+		case CONSOLE_ESC:
+			if (ch == '[') {
+				con->params[0] = 0;
+				con->params[1] = 0;
+				con->param = 0;
+				con->state = CONSOLE_CSI;
+			} else {
+				con->state = CONSOLE_NORMAL;
+			}
+			return;
+
+		case CONSOLE_CSI:
+			if (ch >= '0' && ch <= '9') {
+				if (con->param < 2) {
+					uint16_t val = con->params[con->param] * 10 + (ch - '0');
+					con->params[con->param] = (val > 255) ? 255 : val;
+				}
+			} else if (ch == ';') {
+				con->param++;
+			} else if (ch >= 0x40 && ch <= 0x7E) {
+				// Final byte
+				hd44780_console_csi(con, ch);
+				con->state = CONSOLE_NORMAL;
+			} else if (ch < 0x20 || ch > 0x3F) {
+				// Not a part of control sequence - drop it
+				con->state = CONSOLE_NORMAL;
+			}
+			return;
+
+		default:
+			break;
+	}
+
+	switch (ch) {
+		case ESC:
+			con->state = CONSOLE_ESC;
+			break;
+
+		case '\r':
+			scr->x = 0;
+			break;
+
+		case '\n':
+			hd44780_console_nl(scr);
+			break;
+
+		case '\b':
+			if (scr->x) {
+				scr->x--;
+			}
+			break;
+
+		default:
+			if (ch >= 0x20) {
+				hd44780_console_print(scr, ch);
+			}
+			break;
+	}
+}
+
+void hd44780_console_write(struct hd44780_console *con, const uint8_t *data, size_t len)
+{
+	while (len--) {
+		hd44780_console_putc(con, *data++);
+	}
+}
@@ -0,0 +1,111 @@
+/**
+ * Copyright (C) 2019, Sergey Shcherbakov
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Std headers
+#include <stddef.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+
+// Local headers
+#include "include/hd44780.h"
+#include "include/hd44780_log.h"
+
+/// Display rows addressed by hd44780_update()
+#define HD44780_LOG_DISPLAY_ROWS (2)
+
+void hd44780_log_init(struct hd44780_log *log, uint8_t x, uint8_t y, uint8_t width, uint8_t num_rows)
+{
+	if (width > HD44780_LOG_WIDTH) {
+		width = HD44780_LOG_WIDTH;
+	}
+
+	if (num_rows > HD44780_LOG_LINES) {
+		num_rows = HD44780_LOG_LINES;
+	}
+
+	// Rows beyond hd44780_update() reach would stay blank
+	if (y >= HD44780_LOG_DISPLAY_ROWS) {
+		num_rows = 0;
+	} else if (num_rows > HD44780_LOG_DISPLAY_ROWS - y) {
+		num_rows = HD44780_LOG_DISPLAY_ROWS - y;
+	}
+
+	log->x = x;
+	log->y = y;
+	log->width = width;
+	log->num_rows = num_rows;
+	log->head = HD44780_LOG_LINES - 1;
+	log->count = 0;
+	log->dirty = true;
+}
+
+void hd44780_log_append(struct hd44780_log *log, const char *text)
+{
+	uint8_t head = (log->head + 1) % HD44780_LOG_LINES;
+	uint8_t len = 0;
+
+	while (text[len] && len < log->width) {
+		log->lines[head][len] = text[len];
+		len++;
+	}
+
+	log->len[head] = len;
+	log->head = head;
+	if (log->count < HD44780_LOG_LINES) {
+		log->count++;
+	}
+	log->dirty = true;
+}
+
+void hd44780_log_printf(struct hd44780_log *log, const char *fmt, ...)
+{
+	char buf[HD44780_LOG_WIDTH + 1];
+	va_list arg_ptr;
+
+	va_start(arg_ptr, fmt);
+	vsnprintf(buf, sizeof(buf), fmt, arg_ptr);
+	va_end(arg_ptr);
+
+	hd44780_log_append(log, buf);
+}
+
+void hd44780_log_flush(struct hd44780_log *log)
+{
+	uint8_t row[HD44780_LOG_WIDTH];
+	uint8_t line;
+	uint8_t r;
+
+	if (!log->dirty) {
+		return;
+	}
+
+	// The newest line is at the bottom row
+	for (r = 0; r < log->num_rows; r++) {
+		uint8_t age = log->num_rows - 1 - r;
+
+		memset(row, ' ', log->width);
+
+		if (age < log->count) {
+			line = (log->head + HD44780_LOG_LINES - age) % HD44780_LOG_LINES;
+			memcpy(row, log->lines[line], log->len[line]);
+		}
+
+		hd44780_update(log->x, log->y + r, row, log->width);
+	}
+
+	log->dirty = false;
+}
@@ -0,0 +1,168 @@
+/**
+ * Copyright (C) 2019, Sergey Shcherbakov
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Std headers
+#include <stddef.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+
+// libopencm3 headers
+#include <libopencm3/cm3/cortex.h>
+
+// Local headers
+#include "include/hd44780.h"
+#include "include/hd44780_screen.h"
+
+/// Max number of characters in printf buffer
+#define HD44780_SCREEN_BUFFER_SIZE (80)
+
+/// Screen shown on the display
+static struct hd44780_screen *hd44780_active;
+
+void hd44780_screen_init(struct hd44780_screen *scr, uint8_t width, uint8_t num_lines)
+{
+	if (width > HD44780_SCREEN_WIDTH) {
+		width = HD44780_SCREEN_WIDTH;
+	}
+
+	if (num_lines > HD44780_SCREEN_LINES) {
+		num_lines = HD44780_SCREEN_LINES;
+	}
+
+	scr->width = width;
+	scr->num_lines = num_lines;
+
+	hd44780_screen_clear(scr);
+}
+
+void hd44780_screen_clear(struct hd44780_screen *scr)
+{
+	memset(scr->cells, ' ', sizeof(scr->cells));
+	scr->x = 0;
+	scr->y = 0;
+	scr->dirty = (1u << scr->num_lines) - 1;
+}
+
+void hd44780_screen_gotoxy(struct hd44780_screen *scr, uint8_t x, uint8_t y)
+{
+	if (x >= scr->width) {
+		y++;
+		x = 0;
+	}
+
+	if (y >= scr->num_lines) {
+		x = 0;
+		y = 0;
+	}
+
+	scr->x = x;
+	scr->y = y;
+}
+
+void hd44780_screen_putchar(struct hd44780_screen *scr, int ch)
+{
+	if (ch == '\n') {
+		hd44780_screen_gotoxy(scr, 0, scr->y + 1);
+		return;
+	}
+
+	if (scr->cells[scr->y][scr->x] != (uint8_t)ch) {
+		scr->cells[scr->y][scr->x] = ch;
+		scr->dirty |= 1u << scr->y;
+	}
+
+	hd44780_screen_gotoxy(scr, scr->x + 1, scr->y);
+}
+
+void hd44780_screen_putchar_xy(struct hd44780_screen *scr, uint8_t x, uint8_t y, int ch)
+{
+	hd44780_screen_gotoxy(scr, x, y);
+	hd44780_screen_putchar(scr, ch);
+}
+
+static int hd44780_screen_vsprintf(struct hd44780_screen *scr, const char *fmt, va_list arg_ptr)
+{
+	char buf[HD44780_SCREEN_BUFFER_SIZE];
+	int i, len;
+
+	len = vsnprintf(buf, HD44780_SCREEN_BUFFER_SIZE, fmt, arg_ptr);
+
+	for (i = 0; len > 0 && i < len && i < HD44780_SCREEN_BUFFER_SIZE - 1; i++) {
+		hd44780_screen_putchar(scr, buf[i]);
+	}
+
+	return len;
+}
+
+void hd44780_screen_printf(struct hd44780_screen *scr, const char *fmt, ...)
+{
+	va_list arg_ptr;
+
+	va_start(arg_ptr, fmt);
+	hd44780_screen_vsprintf(scr, fmt, arg_ptr);
+	va_end(arg_ptr);
+}
+
+void hd44780_screen_printf_xy(struct hd44780_screen *scr, uint8_t x, uint8_t y, const char *fmt, ...)
+{
+	va_list arg_ptr;
+
+	hd44780_screen_gotoxy(scr, x, y);
+
+	va_start(arg_ptr, fmt);
+	hd44780_screen_vsprintf(scr, fmt, arg_ptr);
+	va_end(arg_ptr);
+}
+
+void hd44780_screen_show(struct hd44780_screen *scr)
+{
+	// Displayed content is unrelated to the new screen
+	if (scr != hd44780_active) {
+		scr->dirty = (1u << scr->num_lines) - 1;
+		hd44780_active = scr;
+	}
+
+	hd44780_screen_flush();
+}
+
+struct hd44780_screen *hd44780_screen_active(void)
+{
+	return hd44780_active;
+}
+
+void hd44780_screen_flush(void)
+{
+	struct hd44780_screen *scr = hd44780_active;
+	uint8_t dirty;
+	uint8_t y;
+
+	if (!scr) {
+		return;
+	}
+
+	// Lines changed during flush (e.g. from interrupt) are kept dirty
+	CM_ATOMIC_BLOCK() {
+		dirty = scr->dirty;
+		scr->dirty = 0;
+	}
+
+	for (y = 0; y < scr->num_lines; y++) {
+		if (dirty & (1u << y)) {
+			hd44780_update(0, y, scr->cells[y], scr->width);
+		}
+	}
+}
@@ -17,21 +17,249 @@
 // Local headers
 #include "include/helper.h"
 
-volatile enum rcc_periph_clken port2RCC(uint32_t port)
-{
-	switch (port) {
-		case GPIOA:
-			return RCC_GPIOA;
-		case GPIOB:
-			return RCC_GPIOB;
-		case GPIOC:
-			return RCC_GPIOC;
-		case GPIOD:
-			return RCC_GPIOD;
-		case GPIOE:
-			return RCC_GPIOE;
-		default:
-			// Halt - stop on break point and wait for debugger
-			__asm__("BKPT");
+/// GPIO ports present on this MCU
+static const struct {
+	uint32_t port;
+	enum rcc_periph_clken rcc;
+} gpio_ports[] = {
+	{ GPIOA, RCC_GPIOA },
+	{ GPIOB, RCC_GPIOB },
+#ifdef GPIOC
+	{ GPIOC, RCC_GPIOC },
+#endif
+#ifdef GPIOD
+	{ GPIOD, RCC_GPIOD },
+#endif
+#ifdef GPIOE
+	{ GPIOE, RCC_GPIOE },
+#endif
+#ifdef GPIOF
+	{ GPIOF, RCC_GPIOF },
+#endif
+#ifdef GPIOG
+	{ GPIOG, RCC_GPIOG },
+#endif
+#ifdef GPIOH
+	{ GPIOH, RCC_GPIOH },
+#endif
+#ifdef GPIOI
+	{ GPIOI, RCC_GPIOI },
+#endif
+#ifdef GPIOJ
+	{ GPIOJ, RCC_GPIOJ },
+#endif
+#ifdef GPIOK
+	{ GPIOK, RCC_GPIOK },
+#endif
+};
+
+#define GPIO_PORTS_NUM (sizeof(gpio_ports) / sizeof(gpio_ports[0]))
+
+static struct {
+	/// Clock references per port
+	uint8_t clock_refs[GPIO_PORTS_NUM];
+	/// Ports holding clock reference of the registry
+	uint16_t clocked;
+	/// Claimed pins per port
+	uint16_t claimed[GPIO_PORTS_NUM];
+	/// Owner of every claimed pin
+	uint8_t owner[GPIO_PORTS_NUM][16];
+	/// Claims waiting for commit
+	struct {
+		uint8_t idx;
+		uint8_t mode;
+		uint8_t pupd;
+		uint16_t gpios;
+		uint16_t high;
+	} pending[GPIO_RES_MAX_PENDING];
+	uint8_t num_pending;
+	struct gpio_res_conflict conflict;
+} gpio_res;
+
+int gpio_port_index(uint32_t port)
+{
+	unsigned int i;
+
+	for (i = 0; i < GPIO_PORTS_NUM; i++) {
+		if (gpio_ports[i].port == port) {
+			return i;
+		}
+	}
+
+	return GPIO_RES_ERR_PORT;
+}
+
+enum rcc_periph_clken port2RCC(uint32_t port)
+{
+	int idx = gpio_port_index(port);
+
+	if (idx < 0) {
+		// Halt - stop on break point and wait for debugger
+		__asm__("BKPT");
+		idx = 0;
+	}
+
+	return gpio_ports[idx].rcc;
+}
+
+int gpio_res_clock_get(uint32_t port)
+{
+	int idx = gpio_port_index(port);
+
+	if (idx < 0) {
+		return idx;
+	}
+
+	if (gpio_res.clock_refs[idx]++ == 0) {
+		rcc_periph_clock_enable(gpio_ports[idx].rcc);
+	}
+
+	return GPIO_RES_OK;
+}
+
+void gpio_res_clock_put(uint32_t port)
+{
+	int idx = gpio_port_index(port);
+
+	if (idx < 0 || gpio_res.clock_refs[idx] == 0) {
+		return;
+	}
+
+	if (--gpio_res.clock_refs[idx] == 0) {
+		rcc_periph_clock_disable(gpio_ports[idx].rcc);
+	}
+}
+
+int gpio_res_claim(uint32_t port, uint16_t gpios, uint8_t mode, uint8_t pupd, bool high, enum gpio_res_owner owner)
+{
+	int idx = gpio_port_index(port);
+	uint16_t busy;
+	uint8_t i;
+
+	if (idx < 0) {
+		return idx;
+	}
+
+	busy = gpio_res.claimed[idx] & gpios;
+	if (busy) {
+		gpio_res.conflict.port = port;
+		gpio_res.conflict.gpios = busy;
+		gpio_res.conflict.owner = gpio_res.owner[idx][__builtin_ctz(busy)];
+		gpio_res.conflict.claimer = owner;
+		return GPIO_RES_ERR_CONFLICT;
+	}
+
+	// Merge with pending group of the same configuration
+	for (i = 0; i < gpio_res.num_pending; i++) {
+		if (gpio_res.pending[i].idx == idx &&
+				gpio_res.pending[i].mode == mode &&
+				gpio_res.pending[i].pupd == pupd) {
+			break;
+		}
+	}
+
+	if (i == gpio_res.num_pending) {
+		if (gpio_res.num_pending == GPIO_RES_MAX_PENDING) {
+			return GPIO_RES_ERR_FULL;
+		}
+
+		gpio_res.pending[i].idx = idx;
+		gpio_res.pending[i].mode = mode;
+		gpio_res.pending[i].pupd = pupd;
+		gpio_res.pending[i].gpios = 0;
+		gpio_res.pending[i].high = 0;
+		gpio_res.num_pending++;
+	}
+
+	gpio_res.pending[i].gpios |= gpios;
+	if (high) {
+		gpio_res.pending[i].high |= gpios;
+	}
+
+	gpio_res.claimed[idx] |= gpios;
+	for (i = 0; i < 16; i++) {
+		if (gpios & (1u << i)) {
+			gpio_res.owner[idx][i] = owner;
+		}
 	}
+
+	return GPIO_RES_OK;
+}
+
+void gpio_res_commit(void)
+{
+	uint32_t port;
+	uint16_t low;
+	uint8_t i;
+
+	for (i = 0; i < gpio_res.num_pending; i++) {
+		port = gpio_ports[gpio_res.pending[i].idx].port;
+
+		// Registry holds one clock reference per port with claimed pins
+		if (!(gpio_res.clocked & (1u << gpio_res.pending[i].idx))) {
+			gpio_res.clocked |= 1u << gpio_res.pending[i].idx;
+			gpio_res_clock_get(port);
+		}
+
+		low = gpio_res.pending[i].gpios & ~gpio_res.pending[i].high;
+		if (gpio_res.pending[i].high) {
+			gpio_set(port, gpio_res.pending[i].high);
+		}
+		if (low) {
+			gpio_clear(port, low);
+		}
+		gpio_mode_setup(port, gpio_res.pending[i].mode, gpio_res.pending[i].pupd, gpio_res.pending[i].gpios);
+	}
+
+	gpio_res.num_pending = 0;
+}
+
+void gpio_res_abort(void)
+{
+	uint8_t i;
+
+	for (i = 0; i < gpio_res.num_pending; i++) {
+		gpio_res.claimed[gpio_res.pending[i].idx] &= ~gpio_res.pending[i].gpios;
+	}
+
+	gpio_res.num_pending = 0;
+}
+
+void gpio_res_release(uint32_t port, uint16_t gpios)
+{
+	int idx = gpio_port_index(port);
+
+	if (idx < 0 || !(gpio_res.claimed[idx] & gpios)) {
+		return;
+	}
+
+	gpio_res.claimed[idx] &= ~gpios;
+	if (gpio_res.claimed[idx] == 0 && (gpio_res.clocked & (1u << idx))) {
+		gpio_res.clocked &= ~(1u << idx);
+		gpio_res_clock_put(port);
+	}
+}
+
+void gpio_res_release_owner(enum gpio_res_owner owner)
+{
+	uint16_t gpios;
+	uint8_t idx, i;
+
+	for (idx = 0; idx < GPIO_PORTS_NUM; idx++) {
+		gpios = 0;
+		for (i = 0; i < 16; i++) {
+			if ((gpio_res.claimed[idx] & (1u << i)) && gpio_res.owner[idx][i] == owner) {
+				gpios |= 1u << i;
+			}
+		}
+
+		if (gpios) {
+			gpio_res_release(gpio_ports[idx].port, gpios);
+		}
+	}
+}
+
+const struct gpio_res_conflict *gpio_res_last_conflict(void)
+{
+	return &gpio_res.conflict;
 }
@@ -25,6 +25,7 @@
 #define _HD44780_H_
 
 /* Std headers */
+#include <stddef.h>
 #include <stdint.h>
 #include <stdbool.h>
 
@@ -38,6 +39,7 @@ struct hd44780_gpio {
 struct hd44780_bus {
 	struct hd44780_gpio rs;
 	struct hd44780_gpio e;
+	/// Port is 0 if RnW is tied to ground, so data can't be read back
 	struct hd44780_gpio rnw;
 	struct hd44780_gpio db7;
 	struct hd44780_gpio db6;
@@ -49,6 +51,108 @@ struct hd44780_bus {
 	struct hd44780_gpio db0;
 };
 
+/// Max number of additional displays sharing the bus
+#ifndef HD44780_GROUP_MAX
+#define HD44780_GROUP_MAX (3)
+#endif
+
+/**
+ * Group of identical displays sharing RS, RnW and DB lines of hd44780_bus
+ *
+ * Display 0 is strobed by E of hd44780_bus, display N by e[N - 1]. Selected
+ * displays are strobed together, so mirrored updates cost the same bus time
+ * as a single display.
+ */
+struct hd44780_group {
+	/// E lines of additional displays
+	struct hd44780_gpio e[HD44780_GROUP_MAX];
+	/// Number of additional displays
+	uint8_t num;
+
+	/* Filled by driver */
+	/// Displays selected for writes, bit N is display N
+	uint8_t selected;
+	/// Displays which missed writes to other displays, bit N is display N
+	uint8_t divergent;
+};
+
+/// Instructions, value of instruction is the highest bit set
+enum hd44780_op {
+	HD44780_OP_CLEAR = 0,
+	HD44780_OP_HOME,
+	HD44780_OP_ENTRY_MODE,
+	HD44780_OP_DISPLAY_CTRL,
+	HD44780_OP_SHIFT,
+	HD44780_OP_FUNCTION_SET,
+	HD44780_OP_CGRAM_ADDR,
+	HD44780_OP_DDRAM_ADDR,
+	/// Data write to CG or DD RAM
+	HD44780_OP_DATA,
+	/// Busy flag and address read
+	HD44780_OP_BUSY,
+	/// Data read from CG or DD RAM
+	HD44780_OP_READ,
+	/// Single half-byte, e.g. on init
+	HD44780_OP_NIBBLE,
+	HD44780_OP_NONE = 0xFF,
+};
+
+/* Flags of trace entry */
+#define HD44780_TRACE_RS        0x01
+#define HD44780_TRACE_RNW       0x02
+#define HD44780_TRACE_NIBBLE    0x04
+
+/// Bus transaction recorded by trace
+struct hd44780_trace_entry {
+	/// HD44780_TRACE_TIMESTAMP(), DWT cycles by default
+	uint32_t timestamp;
+	/// HD44780_TRACE_xxx flags
+	uint8_t flags;
+	/// Data byte or half-byte
+	uint8_t data;
+	/// Decoded instruction, enum hd44780_op
+	uint8_t op;
+	/// Strobed displays, bit N is display N
+	uint8_t displays;
+};
+
+// Enable bus transactions trace
+//#define HD44780_TRACE
+
+/// Number of trace entries, should be power of 2
+#ifndef HD44780_TRACE_SIZE
+#define HD44780_TRACE_SIZE (256)
+#endif
+
+/// Counters of DDRAM verifier
+struct hd44780_verify_stats {
+	/// Cells read back
+	uint32_t checked;
+	/// Cells differing from expected content
+	uint32_t detected;
+	/// Cells rewritten and read back correctly
+	uint32_t corrected;
+};
+
+/// Counters of instructions removed from bus
+struct hd44780_elide_stats {
+	/// Instructions not changing controller state
+	uint32_t elided;
+	/// Queued instructions overridden or cancelled by following ones
+	uint32_t merged;
+	/// Return home replaced by DDRAM address set
+	uint32_t shortened;
+};
+
+/// Execution times of instructions and data writes
+struct hd44780_timing {
+	/// Indexed by enum hd44780_op, HD44780_OP_CLEAR up to HD44780_OP_DATA, us
+	uint16_t exec_us[HD44780_OP_DATA + 1];
+};
+
+/// hd44780_init_fast() has found live controller and skipped power-on sequence
+#define HD44780_WARM_START (1)
+
 // Enable converting for russian fonts
 //#define hd44780_DO_CONVERT_RUS
 
@@ -113,8 +217,32 @@ void hd44780_set_DDRAM_addr(uint8_t addr);
  * @param	width		Display width
  * @param	num_lines	Number of display lines
  * @param	big_fonts	5x10 dots fonts if true, otherwise 5x8
+ * @return	GPIO_RES_OK or negative GPIO registry error code, e.g.
+ *		GPIO_RES_ERR_CONFLICT if bus line is already used by keys
+ */
+int hd44780_init(struct hd44780_bus *bus_props, uint8_t width, bool bus8, uint8_t num_lines, bool big_fonts);
+
+/**
+ * @brief Init of HT44780 display, skip power-on sequence if display kept powered
+ *
+ * Controller is resynchronized and checked for busy flag and signature,
+ * which is kept in 2 DDRAM cells out of visible area (written on every
+ * clear). If it's found, configuration is applied again and DDRAM and
+ * CGRAM content is read back, otherwise full power-on sequence is done.
+ * Requires wired RnW line, up to 2 display lines and width up to 38
+ * characters. Display shift by hd44780_cursor_ctrl() or shifting entry mode
+ * brings signature into view, every DDRAM cell of a line is reachable by
+ * shift.
+ *
+ * @param	bus_props	Data bus GPIO descriptor
+ * @param	bus8		8-bits long bus
+ * @param	width		Display width
+ * @param	num_lines	Number of display lines
+ * @param	big_fonts	5x10 dots fonts if true, otherwise 5x8
+ * @return	HD44780_WARM_START, GPIO_RES_OK after full power-on sequence or
+ *		negative GPIO registry error code
  */
-void hd44780_init(struct hd44780_bus *bus_props, uint8_t width, bool bus8, uint8_t num_lines, bool big_fonts);
+int hd44780_init_fast(struct hd44780_bus *bus_props, uint8_t width, bool bus8, uint8_t num_lines, bool big_fonts);
 
 /**
  * @brief Put character on a display
@@ -130,6 +258,19 @@ void hd44780_putchar(int ch);
  */
 void hd44780_putchar_xy(uint8_t x, uint8_t y, int ch);
 
+/**
+ * @brief Update part of line, only cells differing from displayed ones are sent
+ *
+ * Address is set only when the next changed cell isn't adjacent to the
+ * previous one, so cost is proportional to the visual difference.
+ *
+ * @param	x		X-axis, starts at 0
+ * @param	y		Y-axis, starts at 0
+ * @param	data	New cells content
+ * @param	len		Number of cells, clipped by display width
+ */
+void hd44780_update(uint8_t x, uint8_t y, const uint8_t *data, uint8_t len);
+
 /**
  * Basic printf implementation for LCD
  * @param	fmt		Text and formating
@@ -146,6 +287,173 @@ void hd44780_printf(const char *fmt, ...);
  */
 void hd44780_printf_xy(uint8_t x, uint8_t y, const char *fmt, ...);
 
+/**
+ * @brief Enable or disable deferred mode
+ *
+ * In deferred mode bus transfers are queued and performed by hd44780_step(),
+ * so printing doesn't wait for the controller. If the queue is full, writer
+ * falls back to blocking. Disabling deferred mode flushes the queue.
+ *
+ * @param	deferred	Queue transfers if true
+ */
+void hd44780_set_deferred(bool deferred);
+
+/**
+ * @brief Perform queued transfers, non-blocking
+ *
+ * Transfers are started only while the controller becomes ready before
+ * deadline, so execution of long instructions (e.g. clear) spans calls.
+ *
+ * @param	deadline	micros() time to return by
+ * @return	Number of transfers left in queue
+ */
+uint16_t hd44780_step(uint32_t deadline);
+
+/**
+ * @brief Scheduler task wrapper for hd44780_step()
+ * @param	ctx			Unused
+ * @param	deadline	micros() time to return by
+ */
+void hd44780_task(void *ctx, uint32_t deadline);
+
+/**
+ * @brief Check if controller is busy
+ *
+ * Busy flag is read if RnW line is wired, otherwise expected execution
+ * time of the last instruction is checked.
+ *
+ * @return	True if controller is busy
+ */
+bool hd44780_busy(void);
+
+/**
+ * @brief Configure background DDRAM verifier
+ *
+ * Verifier reads back visible cells, compares them with expected content
+ * and rewrites corrupted ones. Verification takes about
+ * slice * 80 us of bus time per period.
+ *
+ * @param	slice	Number of cells verified per period
+ * @param	period	Period of verification, us
+ */
+void hd44780_verify_setup(uint8_t slice, uint32_t period);
+
+/**
+ * @brief Verify next slice of DDRAM, non-blocking
+ *
+ * Does nothing if RnW line isn't wired, deferred transfers are pending or
+ * verification period hasn't passed yet.
+ *
+ * @param	deadline	micros() time to return by
+ * @return	Number of verified cells
+ */
+uint8_t hd44780_verify_step(uint32_t deadline);
+
+/**
+ * @brief Scheduler task wrapper for hd44780_verify_step()
+ * @param	ctx			Unused
+ * @param	deadline	micros() time to return by
+ */
+void hd44780_verify_task(void *ctx, uint32_t deadline);
+
+/**
+ * @brief Get counters of DDRAM verifier
+ * @return	Verifier counters
+ */
+const struct hd44780_verify_stats *hd44780_verify_get_stats(void);
+
+/**
+ * @brief Get counters of instructions removed from bus
+ *
+ * Instructions which don't change mirrored entry mode, display control,
+ * address counter or display shift are dropped. In deferred mode queued
+ * instructions overridden by the following ones are dropped too.
+ *
+ * @return	Counters, reset on init
+ */
+const struct hd44780_elide_stats *hd44780_elide_get_stats(void);
+
+/**
+ * @brief Measure execution times of instructions by busy flag, RnW line
+ * should be wired
+ *
+ * Every instruction class is executed HD44780_CALIBRATE_RUNS times and the
+ * longest time is stored with margin. Execution time depends on oscillator,
+ * so margin should cover supply voltage and temperature drift. Display is
+ * cleared, also on failure. Deferred mode is suspended while measuring and
+ * restored afterwards. With group of displays only the first one is
+ * measured.
+ *
+ * @param	timing	Measured timing profile
+ * @param	margin	Safety margin, percents
+ * @return	True on success, false if bus is write-only or busy flag is stuck
+ */
+bool hd44780_calibrate(struct hd44780_timing *timing, uint8_t margin);
+
+/**
+ * @brief Use timing profile instead of datasheet execution times
+ *
+ * Profile measured on a board with RnW wired may be loaded on write-only
+ * boards with the same panel model. Profile isn't copied.
+ *
+ * @param	timing	Timing profile, NULL restores datasheet timing
+ */
+void hd44780_set_timing(const struct hd44780_timing *timing);
+
+/**
+ * @brief Write contiguous run of characters at point[x,y]
+ *
+ * Address is set once, then every character is a single data transfer.
+ * Data runs through DDRAM as the address counter does (line 0 continues
+ * at line 1).
+ *
+ * @param	x		X-axis, starts at 0
+ * @param	y		Y-axis, starts at 0
+ * @param	data	Characters
+ * @param	len		Number of characters
+ */
+void hd44780_write_block(uint8_t x, uint8_t y, const uint8_t *data, size_t len);
+
+/**
+ * @brief Write contiguous run of bytes to the character generator RAM
+ * @param	addr	CGRAM address, character N starts at N * 8
+ * @param	data	Pattern bytes
+ * @param	len		Number of bytes
+ */
+void hd44780_write_cgram_block(uint8_t addr, const uint8_t *data, size_t len);
+
+/**
+ * @brief Attach group of displays sharing the bus, should be called before init
+ * @param	group	Group of displays
+ */
+void hd44780_group_attach(struct hd44780_group *group);
+
+/**
+ * @brief Select displays for subsequent writes
+ *
+ * Displays not selected become divergent on the next write. Data is read
+ * back from display 0 only, so the verifier runs only when all displays are
+ * selected and none is divergent.
+ *
+ * @param	mask	Displays, bit N is display N
+ */
+void hd44780_group_select(uint8_t mask);
+
+/**
+ * @brief Get displays which content diverged
+ * @return	Displays mask, bit N is display N
+ */
+uint8_t hd44780_group_divergent(void);
+
+/**
+ * @brief Copy current state to divergent displays and select all displays
+ *
+ * Function set, display control, CGRAM, visible DDRAM, display shift and
+ * entry mode are replayed, so divergent displays match the others. CGRAM
+ * is replayed only once it was written or read back on warm start.
+ */
+void hd44780_group_resync(void);
+
 /**
  * @brief Put user-defined character pattern for the character to the character generator RAM
  * @param	addr		Character address in the character generator RAM
@@ -154,4 +462,25 @@ void hd44780_printf_xy(uint8_t x, uint8_t y, const char *fmt, ...);
  */
 void hd44780_define_char(uint8_t addr, uint8_t* pattern, uint8_t size);
 
+#ifdef HD44780_TRACE
+/**
+ * @brief Get trace ring buffer
+ * @param	head	Number of recorded entries, the next entry is written
+ *			at head % HD44780_TRACE_SIZE
+ * @return	Array of HD44780_TRACE_SIZE entries
+ */
+const struct hd44780_trace_entry *hd44780_trace_get(uint32_t *head);
+
+/**
+ * @brief Dump trace as text, oldest entry first
+ *
+ * Every entry is a line "T <timestamp> <flags> <data> <op> <displays>" in
+ * hex, which is converted by tools/hd44780_trace into VCD and instruction
+ * listing.
+ *
+ * @param	put_line	Line output, e.g. to UART
+ */
+void hd44780_trace_dump(void (*put_line)(const char *line));
+#endif
+
 #endif // _HD44780_H_
@@ -0,0 +1,76 @@
+/**
+ * Copyright (C) 2019, Sergey Shcherbakov
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ *
+ *
+ * @brief Streaming console sink for HD44780-based LCD displays
+ *
+ * Bytes are accepted in arbitrary chunks and rendered into a virtual screen,
+ * so the sink never touches the bus and can be fed from UART RX interrupt
+ * or DMA buffer. Showing/flushing the screen sends only changed cells.
+ *
+ * Supported VT100 subset:
+ *   CR, LF (new line, scrolls at the bottom), BS
+ *   ESC [ row ; col H  and  ESC [ row ; col f - cursor position, 1-based
+ *   ESC [ n A/B/C/D - cursor up/down/forward/back
+ *   ESC [ 0/1/2 K - clear line to the end/from the start/whole
+ *   ESC [ 0/1/2 J - clear screen to the end/from the start/whole
+ * Other sequences are ignored.
+ */
+
+#ifndef _HD44780_CONSOLE_H_
+#define _HD44780_CONSOLE_H_
+
+/* Std headers */
+#include <stddef.h>
+#include <stdint.h>
+
+/* Local headers */
+#include "hd44780_screen.h"
+
+struct hd44780_console {
+	/// Screen the console is rendered into
+	struct hd44780_screen *scr;
+	/// Parser state
+	uint8_t state;
+	/// Escape sequence parameters
+	uint8_t params[2];
+	/// Index of current parameter
+	uint8_t param;
+};
+
+/**
+ * @brief Init console
+ * @param	con	Console
+ * @param	scr	Screen the console is rendered into, should be initialized
+ */
+void hd44780_console_init(struct hd44780_console *con, struct hd44780_screen *scr);
+
+/**
+ * @brief Feed one byte to console
+ * @param	con	Console
+ * @param	ch	Byte
+ */
+void hd44780_console_putc(struct hd44780_console *con, uint8_t ch);
+
+/**
+ * @brief Feed chunk of bytes to console
+ * @param	con		Console
+ * @param	data	Bytes
+ * @param	len		Number of bytes
+ */
+void hd44780_console_write(struct hd44780_console *con, const uint8_t *data, size_t len);
+
+#endif // _HD44780_CONSOLE_H_
@@ -0,0 +1,98 @@
+/**
+ * Copyright (C) 2019, Sergey Shcherbakov
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ *
+ *
+ * @brief Scrolling log console for HD44780-based LCD displays
+ *
+ * Lines are kept in a ring buffer and shown in a window of display rows,
+ * the newest line at the bottom. Appending only copies the text; the
+ * window is redrawn by hd44780_log_flush(), which sends only the cells
+ * differing from the displayed ones. With deferred mode the redraw is
+ * only queued, so the queue should fit about 2 * width * rows transfers.
+ */
+
+#ifndef _HD44780_LOG_H_
+#define _HD44780_LOG_H_
+
+/* Std headers */
+#include <stdint.h>
+#include <stdbool.h>
+
+/// Max width of log line
+#ifndef HD44780_LOG_WIDTH
+#define HD44780_LOG_WIDTH (20)
+#endif
+
+/// Number of lines kept in log
+#ifndef HD44780_LOG_LINES
+#define HD44780_LOG_LINES (4)
+#endif
+
+struct hd44780_log {
+	/// Lines ring buffer
+	uint8_t lines[HD44780_LOG_LINES][HD44780_LOG_WIDTH];
+	/// Length of every line
+	uint8_t len[HD44780_LOG_LINES];
+	/// Index of the newest line
+	uint8_t head;
+	/// Number of lines in log
+	uint8_t count;
+	/// First column of window
+	uint8_t x;
+	/// First display row of window
+	uint8_t y;
+	/// Number of rows in window
+	uint8_t num_rows;
+	/// Window width
+	uint8_t width;
+	/// Lines appended since last flush
+	bool dirty;
+};
+
+/**
+ * @brief Init log console, it's empty
+ * @param	log			Log console
+ * @param	x			First column of window
+ * @param	y			First display row of window
+ * @param	width		Window width, up to HD44780_LOG_WIDTH
+ * @param	num_rows	Number of rows in window, up to HD44780_LOG_LINES;
+ *				clamped to display rows 0 and 1, which are the only rows
+ *				hd44780_update() writes
+ */
+void hd44780_log_init(struct hd44780_log *log, uint8_t x, uint8_t y, uint8_t width, uint8_t num_rows);
+
+/**
+ * @brief Append line, never touches the bus
+ * @param	log		Log console
+ * @param	text	Line text, cut by window width
+ */
+void hd44780_log_append(struct hd44780_log *log, const char *text);
+
+/**
+ * Basic printf implementation for log console, appends one line
+ * @param	log		Log console
+ * @param	fmt		Text and formating
+ * @param	...		Arguments
+ */
+void hd44780_log_printf(struct hd44780_log *log, const char *fmt, ...);
+
+/**
+ * @brief Redraw window, only changed cells are sent
+ * @param	log		Log console
+ */
+void hd44780_log_flush(struct hd44780_log *log);
+
+#endif // _HD44780_LOG_H_
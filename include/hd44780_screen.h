@@ -0,0 +1,136 @@
+/**
+ * Copyright (C) 2019, Sergey Shcherbakov
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ *
+ *
+ * @brief Virtual screens for HD44780-based LCD displays
+ *
+ * Screens are RAM buffers updated without touching the bus. Only the
+ * active screen is transferred to the display by hd44780_screen_flush(),
+ * and only cells differing from the displayed ones are sent, so switching
+ * pages costs proportionally to the visual difference.
+ */
+
+#ifndef _HD44780_SCREEN_H_
+#define _HD44780_SCREEN_H_
+
+/* Std headers */
+#include <stdint.h>
+#include <stdbool.h>
+
+/// Max width of screen
+#ifndef HD44780_SCREEN_WIDTH
+#define HD44780_SCREEN_WIDTH (20)
+#endif
+
+/// Max number of screen lines
+#ifndef HD44780_SCREEN_LINES
+#define HD44780_SCREEN_LINES (2)
+#endif
+
+struct hd44780_screen {
+	/// Screen content
+	uint8_t cells[HD44780_SCREEN_LINES][HD44780_SCREEN_WIDTH];
+	/// Screen width
+	uint8_t width;
+	/// Number of screen lines
+	uint8_t num_lines;
+	/// Printing position
+	uint8_t x;
+	uint8_t y;
+	/// Lines changed since last flush, bit N is line N
+	uint8_t dirty;
+};
+
+/**
+ * @brief Init screen, it's cleared
+ * @param	scr			Screen
+ * @param	width		Screen width, up to HD44780_SCREEN_WIDTH
+ * @param	num_lines	Number of screen lines, up to HD44780_SCREEN_LINES
+ */
+void hd44780_screen_init(struct hd44780_screen *scr, uint8_t width, uint8_t num_lines);
+
+/**
+ * @brief Clear screen, never touches the bus
+ * @param	scr	Screen
+ */
+void hd44780_screen_clear(struct hd44780_screen *scr);
+
+/**
+ * @brief Move printing position of screen
+ * @param	scr	Screen
+ * @param	x	X-axis, starts at 0
+ * @param	y	Y-axis, starts at 0
+ */
+void hd44780_screen_gotoxy(struct hd44780_screen *scr, uint8_t x, uint8_t y);
+
+/**
+ * @brief Put character on screen, never touches the bus
+ * @param	scr	Screen
+ * @param	ch	Character to be printed, '\n' jumps to new line
+ */
+void hd44780_screen_putchar(struct hd44780_screen *scr, int ch);
+
+/**
+ * @brief Put character on screen at point[x,y], never touches the bus
+ * @param	scr	Screen
+ * @param	x	X-axis, starts at 0
+ * @param	y	Y-axis, starts at 0
+ * @param	ch	Character to be printed
+ */
+void hd44780_screen_putchar_xy(struct hd44780_screen *scr, uint8_t x, uint8_t y, int ch);
+
+/**
+ * Basic printf implementation for screen, never touches the bus
+ * @param	scr		Screen
+ * @param	fmt		Text and formating
+ * @param	...		Arguments
+ */
+void hd44780_screen_printf(struct hd44780_screen *scr, const char *fmt, ...);
+
+/**
+ * Basic printf implementation for screen with initial point definition
+ * @param	scr		Screen
+ * @param	x		X-axis, starts at 0
+ * @param	y		Y-axis, starts at 0
+ * @param	fmt		Text and formating
+ * @param	...		Arguments
+ */
+void hd44780_screen_printf_xy(struct hd44780_screen *scr, uint8_t x, uint8_t y, const char *fmt, ...);
+
+/**
+ * @brief Make screen active and transfer difference to the display
+ * @param	scr	Screen
+ */
+void hd44780_screen_show(struct hd44780_screen *scr);
+
+/**
+ * @brief Get active screen
+ * @return	Active screen or NULL
+ */
+struct hd44780_screen *hd44780_screen_active(void);
+
+/**
+ * @brief Transfer changed lines of active screen to the display
+ *
+ * With deferred mode enabled transfers are only queued. Dirty lines are
+ * taken with interrupts masked, so lines changed from interrupt during
+ * flush are sent on the next flush. A line changed by interrupt while it's
+ * being sent, e.g. scrolled by console, may be shown torn until the next
+ * flush.
+ */
+void hd44780_screen_flush(void);
+
+#endif // _HD44780_SCREEN_H_
@@ -14,12 +14,131 @@
  * limitations under the License.
  */
 
+#ifndef HELPER_H
+#define HELPER_H
+
 // Std headers
 #include <stddef.h>
 #include <stdint.h>
 
+#include <stdbool.h>
+
 // libopencm3 headers
 #include <libopencm3/stm32/rcc.h>
 #include <libopencm3/stm32/gpio.h>
 
-volatile enum rcc_periph_clken port2RCC(uint32_t port);
+/* Time base, provided by application */
+extern void sleep_ms(uint32_t ms);
+extern void sleep_us(uint32_t us);
+/// Free running microseconds counter, wraps around
+extern uint32_t micros(void);
+
+/// True if timestamp a is before timestamp b, wrap-around safe
+#define TIME_BEFORE(a, b) ((int32_t)((a) - (b)) < 0)
+
+/// Max number of pending (port, mode, pull-up) groups between claim and commit
+#ifndef GPIO_RES_MAX_PENDING
+#define GPIO_RES_MAX_PENDING (8)
+#endif
+
+/* GPIO registry error codes */
+#define GPIO_RES_OK             (0)
+/// Port is not present on this MCU
+#define GPIO_RES_ERR_PORT       (-1)
+/// Pin is already claimed by other driver
+#define GPIO_RES_ERR_CONFLICT   (-2)
+/// Too many pending groups
+#define GPIO_RES_ERR_FULL       (-3)
+
+/// Owners of GPIO pins
+enum gpio_res_owner {
+	GPIO_RES_OWNER_NONE = 0,
+	GPIO_RES_OWNER_USER,
+	GPIO_RES_OWNER_HD44780,
+	GPIO_RES_OWNER_KEYS,
+};
+
+/// Description of last detected pin conflict
+struct gpio_res_conflict {
+	/// GPIO port id
+	uint32_t port;
+	/// GPIO pins claimed twice
+	uint16_t gpios;
+	/// Owner of the pins
+	enum gpio_res_owner owner;
+	/// Driver tried to claim the pins
+	enum gpio_res_owner claimer;
+};
+
+/**
+ * @brief Get index of GPIO port
+ * @param	port	GPIO port id
+ * @return	Index of port (GPIOA is 0) or GPIO_RES_ERR_PORT
+ */
+int gpio_port_index(uint32_t port);
+
+/**
+ * @brief Get RCC clock of GPIO port
+ * @param	port	GPIO port id, should be a valid port
+ * @return	RCC clock of the port
+ */
+enum rcc_periph_clken port2RCC(uint32_t port);
+
+/**
+ * @brief Enable clock of GPIO port, reference counted
+ * @param	port	GPIO port id
+ * @return	GPIO_RES_OK or GPIO_RES_ERR_PORT
+ */
+int gpio_res_clock_get(uint32_t port);
+
+/**
+ * @brief Release clock of GPIO port, it's disabled on last reference
+ * @param	port	GPIO port id
+ */
+void gpio_res_clock_put(uint32_t port);
+
+/**
+ * @brief Claim GPIO pins, configuration is postponed up to gpio_res_commit()
+ * @param	port	GPIO port id
+ * @param	gpios	GPIO pins
+ * @param	mode	GPIO mode (GPIO_MODE_xxx)
+ * @param	pupd	Pull-up/pull-down (GPIO_PUPD_xxx)
+ * @param	high	Initial level of output data register
+ * @param	owner	Driver claiming the pins
+ * @return	GPIO_RES_OK or negative error code
+ */
+int gpio_res_claim(uint32_t port, uint16_t gpios, uint8_t mode, uint8_t pupd, bool high, enum gpio_res_owner owner);
+
+/**
+ * @brief Apply all pending claims
+ *
+ * Clock of each port is enabled once and pins sharing port, mode and
+ * pull-up are configured by single gpio_mode_setup() call.
+ */
+void gpio_res_commit(void);
+
+/**
+ * @brief Drop all pending claims and release its pins
+ */
+void gpio_res_abort(void);
+
+/**
+ * @brief Release claimed GPIO pins
+ * @param	port	GPIO port id
+ * @param	gpios	GPIO pins
+ */
+void gpio_res_release(uint32_t port, uint16_t gpios);
+
+/**
+ * @brief Release all GPIO pins claimed by owner, e.g. before driver re-init
+ * @param	owner	Owner of pins
+ */
+void gpio_res_release_owner(enum gpio_res_owner owner);
+
+/**
+ * @brief Get last detected pin conflict
+ * @return	Last conflict, port is 0 if there were no conflicts
+ */
+const struct gpio_res_conflict *gpio_res_last_conflict(void);
+
+#endif // HELPER_H
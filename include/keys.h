@@ -25,6 +25,20 @@
 #ifndef KEYS_H
 #define KEYS_H
 
+/// Max number of rows in keys matrix
+#ifndef KEYS_MATRIX_MAX_ROWS
+#define KEYS_MATRIX_MAX_ROWS (8)
+#endif
+
+/// Pressed keys bitmask - bit N is set if key N is pressed
+typedef uint64_t keys_mask_t;
+
+/// Number of keys in keys bitmask
+#define KEYS_MASK_BITS (64)
+
+/// Keys don't fit keys bitmask, distinct from GPIO registry error codes
+#define KEYS_ERR_SIZE (-4)
+
 /// Descriptor of buttons
 struct keys_s {
 	/// GPIO port id
@@ -45,13 +59,73 @@ struct keys_s {
 #endif
 };
 
+/**
+ * Descriptor of keys matrix
+ *
+ * Rows are driven low one by one (open-drain), columns are sensed with
+ * pull-ups. All rows should be on one port and all columns should be on one
+ * port, so a whole row is read by a single port read.
+ */
+struct keys_matrix_s {
+	/// GPIO port of rows
+	uint32_t row_port;
+	/// GPIO pins of rows - one pin per row
+	const uint16_t *rows;
+	/// Number of rows, up to KEYS_MATRIX_MAX_ROWS
+	uint8_t num_rows;
+	/// GPIO port of columns
+	uint32_t col_port;
+	/// GPIO pins of columns - one pin per column
+	const uint16_t *cols;
+	/// Number of columns, up to 16; num_rows * num_cols + first_bit should
+	/// not exceed KEYS_MASK_BITS
+	uint8_t num_cols;
+	/// Enable Pull-Up on column pins
+	bool pup;
+	/// Position of key [row 0, col 0] in keys bitmask
+	uint8_t first_bit;
+
+	/* Filled by keys_matrix_setup() */
+	/// All row pins
+	uint16_t row_mask;
+	/// All column pins
+	uint16_t col_mask;
+	/// Column pins are adjacent and ascending
+	bool col_linear;
+	/// Position of first column pin if col_linear
+	uint8_t col_shift;
+	/// Columns pressed in each row on last scan
+	uint16_t row_state[KEYS_MATRIX_MAX_ROWS];
+	/// Last reliable matrix state, relative to first_bit
+	keys_mask_t last;
+};
+
+/// Keys poller, e.g. for cooperative scheduler
+struct keys_poll_s {
+	/// Array of keys descriptors, may be NULL
+	struct keys_s *keys;
+	/// Number of descriptors in array
+	int num_keys;
+	/// Keys matrix, may be NULL
+	struct keys_matrix_s *matrix;
+
+	/// Pressed keys on last scan
+	keys_mask_t state;
+	/// Keys pressed since cleared by application
+	keys_mask_t pressed;
+	/// Keys released since cleared by application
+	keys_mask_t released;
+	/// Time of last scan, micros()
+	uint32_t timestamp;
+};
+
 /**
  * @brief Setup keys
  * @param	keys	Array of keys descriptors
  * @param	n	Number of descriptors in array
- * @return	None
+ * @return	GPIO_RES_OK or negative GPIO registry error code
  */
-void keys_setup(struct keys_s *keys, int n);
+int keys_setup(struct keys_s *keys, int n);
 
 /**
  * @brief Check if key is pressed
@@ -61,4 +135,46 @@ void keys_setup(struct keys_s *keys, int n);
  */
 bool key_pressed(struct keys_s *keys, int id);
 
+/**
+ * @brief Read all keys at once
+ * @param	keys	Array of keys descriptors
+ * @param	n	Number of descriptors in array, only the first KEYS_MASK_BITS
+ *			are read
+ * @return	Bitmask of pressed keys, bit N is key N in descriptor
+ */
+keys_mask_t keys_read(struct keys_s *keys, int n);
+
+/**
+ * @brief Setup keys matrix and precompute scan masks
+ * @param	matrix	Keys matrix descriptor
+ * @return	GPIO_RES_OK, KEYS_ERR_SIZE or negative GPIO registry error code
+ */
+int keys_matrix_setup(struct keys_matrix_s *matrix);
+
+/**
+ * @brief Scan keys matrix, one port read per row
+ *
+ * Without diodes three pressed keys in a rectangle corners make the fourth
+ * corner look pressed (ghosting) and hide real state of the fourth key
+ * (masking). Rows involved in such rectangle keep their last reliable state.
+ *
+ * @param	matrix	Keys matrix descriptor
+ * @param	mask	Keys bitmask, pressed matrix keys are added at first_bit
+ * @return	True if ghosting has been detected
+ */
+bool keys_matrix_scan(struct keys_matrix_s *matrix, keys_mask_t *mask);
+
+/**
+ * @brief Scan all keys of poller and accumulate press/release events
+ * @param	poll	Keys poller
+ */
+void keys_poll(struct keys_poll_s *poll);
+
+/**
+ * @brief Scheduler task wrapper for keys_poll()
+ * @param	ctx			Keys poller
+ * @param	deadline	Unused, scan takes fixed time
+ */
+void keys_task(void *ctx, uint32_t deadline);
+
 #endif // KEYS_H
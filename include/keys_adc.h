@@ -0,0 +1,103 @@
+/**
+ * Copyright (C) 2019, Sergey Shcherbakov
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ *
+ *
+ * @brief Analog keys on resistor ladders
+ *
+ * Several keys share one ADC pin through a resistor ladder, every key
+ * gives its own voltage window. All ladders are converted in one ADC scan
+ * sequence and moved by circular DMA into a samples buffer, so decoding is
+ * a pure function of the buffer and can be fed by host waveforms as well.
+ */
+
+#ifndef KEYS_ADC_H
+#define KEYS_ADC_H
+
+// Std headers
+#include <stdint.h>
+#include <stdbool.h>
+
+// Local headers
+#include "keys.h"
+
+/// No key of ladder is pressed
+#define KEYS_ADC_NONE 0xFF
+
+/// Voltage window of key, ADC counts
+struct keys_adc_window {
+	uint16_t lo;
+	uint16_t hi;
+};
+
+/// Descriptor of resistor ladder
+struct keys_ladder_s {
+	/// GPIO port id
+	uint32_t port;
+	/// GPIO pin - should be used only one pin
+	uint16_t gpio;
+	/// ADC channel of the pin
+	uint8_t channel;
+	/// Voltage windows, window N is key N
+	const struct keys_adc_window *windows;
+	/// Number of keys on ladder
+	uint8_t num_keys;
+	/// Window of pressed key is widened by hysteresis, ADC counts
+	uint16_t hysteresis;
+	/// Position of key 0 in keys bitmask
+	uint8_t first_bit;
+
+	/// Pressed key or KEYS_ADC_NONE, filled by keys_adc_decode()
+	uint8_t pressed;
+};
+
+/**
+ * @brief Release all keys of ladders, e.g. before decoding host waveforms
+ * @param	ladders	Array of ladders descriptors
+ * @param	n		Number of descriptors in array
+ */
+void keys_adc_reset(struct keys_ladder_s *ladders, uint8_t n);
+
+/**
+ * @brief Decode ladders samples into keys bitmask
+ *
+ * Key is pressed when its sample enters the window and released when it
+ * leaves the window widened by hysteresis. Every ladder should have keys
+ * and first_bit + num_keys should not exceed KEYS_MASK_BITS, as checked by
+ * keys_adc_setup().
+ *
+ * @param	ladders	Array of ladders descriptors
+ * @param	n		Number of descriptors in array
+ * @param	samples	Samples, sample N is ladder N (ADC scan order)
+ * @return	Bitmask of pressed keys
+ */
+keys_mask_t keys_adc_decode(struct keys_ladder_s *ladders, uint8_t n, const volatile uint16_t *samples);
+
+/**
+ * @brief Setup ADC scan sequence of all ladders with circular DMA
+ *
+ * ADC runs continuously, so samples are always fresh and no CPU time is
+ * spent on conversions. Available on STM32F2/F4/F7, ADC1 with DMA2 stream 0
+ * by default (see KEYS_ADC and KEYS_ADC_DMA).
+ *
+ * @param	ladders	Array of ladders descriptors
+ * @param	n		Number of descriptors in array, up to 16
+ * @param	samples	Samples buffer of n entries
+ * @return	GPIO_RES_OK, KEYS_ERR_SIZE if n is 0 or above 16 or ladder keys
+ *		don't fit keys bitmask, or negative GPIO registry error code
+ */
+int keys_adc_setup(struct keys_ladder_s *ladders, uint8_t n, volatile uint16_t *samples);
+
+#endif // KEYS_ADC_H
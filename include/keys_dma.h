@@ -0,0 +1,147 @@
+/**
+ * Copyright (C) 2019, Sergey Shcherbakov
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ *
+ *
+ * @brief Keys sampling by timer-triggered DMA
+ *
+ * Timer update event triggers DMA copying input register of keys port into
+ * a circular buffer at fixed rate, so sampling costs no CPU time. The CPU
+ * wakes up every N ms and debounces the buffered samples in batch. The
+ * buffer should hold more samples than are taken between two polls.
+ */
+
+#ifndef KEYS_DMA_H
+#define KEYS_DMA_H
+
+// Std headers
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+// Local headers
+#include "keys.h"
+
+/// Debouncer of port pins, pin state changes after 4 equal samples
+struct keys_debounce_s {
+	/// Pins of keys
+	uint16_t pins;
+	/// Pins of keys pressed on low level
+	uint16_t active_low;
+
+	/// Vertical counter of samples differing from state
+	uint16_t cnt0;
+	uint16_t cnt1;
+	/// Debounced pressed pins
+	uint16_t state;
+	/// Pins pressed since cleared by application
+	uint16_t pressed;
+	/// Pins released since cleared by application
+	uint16_t released;
+};
+
+/**
+ * @brief Setup debouncer for keys on port, polarity is the same as of
+ * key_pressed()
+ * @param	db		Debouncer
+ * @param	keys	Array of keys descriptors, keys on other ports are ignored
+ * @param	n		Number of descriptors in array
+ * @param	port	Sampled GPIO port
+ */
+void keys_debounce_setup(struct keys_debounce_s *db, const struct keys_s *keys, int n, uint32_t port);
+
+/**
+ * @brief Debounce batch of port samples, pure function of samples
+ * @param	db		Debouncer
+ * @param	samples	Port input register samples
+ * @param	n		Number of samples
+ */
+void keys_debounce(struct keys_debounce_s *db, const volatile uint16_t *samples, size_t n);
+
+/**
+ * @brief Convert pins bitmask of port into keys bitmask
+ * @param	keys	Array of keys descriptors
+ * @param	n		Number of descriptors in array
+ * @param	port	Sampled GPIO port
+ * @param	pins	Pins bitmask, e.g. debounced state or events
+ * @return	Keys bitmask, bit N is key N in descriptor
+ */
+keys_mask_t keys_debounce_mask(const struct keys_s *keys, int n, uint32_t port, uint16_t pins);
+
+#if defined(STM32F2) || defined(STM32F4) || defined(STM32F7)
+
+// libopencm3 headers
+#include <libopencm3/stm32/rcc.h>
+
+/// Descriptor of keys port sampler
+struct keys_dma_s {
+	/// Sampled GPIO port
+	uint32_t port;
+	/// Array of keys descriptors, keys on other ports are ignored
+	struct keys_s *keys;
+	/// Number of descriptors in array
+	int num_keys;
+	/// Circular samples buffer
+	volatile uint16_t *buffer;
+	/// Number of samples in buffer
+	uint16_t size;
+
+	/// Timer triggering DMA on update event, e.g. TIM1
+	uint32_t timer;
+	enum rcc_periph_clken timer_rcc;
+	/// Timer input clock, Hz
+	uint32_t timer_clock;
+	/// Sampling rate, Hz
+	uint32_t rate;
+
+	/// DMA stream requested by timer update, e.g. DMA2 stream 5 channel 6 for TIM1
+	uint32_t dma;
+	enum rcc_periph_clken dma_rcc;
+	uint8_t stream;
+	uint32_t channel;
+
+	/* Filled by driver */
+	/// Next sample to be processed
+	uint16_t tail;
+	struct keys_debounce_s debounce;
+};
+
+/**
+ * @brief Setup debouncer from keys descriptors and start timer and DMA
+ *
+ * Keys pins should be configured by keys_setup(). Events are converted to
+ * keys by keys_debounce_mask(). Available on STM32F2/F4/F7, where DMA2 can
+ * read GPIO input registers.
+ *
+ * @param	sampler	Keys port sampler
+ */
+void keys_dma_setup(struct keys_dma_s *sampler);
+
+/**
+ * @brief Debounce samples taken since last poll
+ * @param	sampler	Keys port sampler
+ */
+void keys_dma_poll(struct keys_dma_s *sampler);
+
+/**
+ * @brief Scheduler task wrapper for keys_dma_poll()
+ * @param	ctx			Keys port sampler
+ * @param	deadline	Unused
+ */
+void keys_dma_task(void *ctx, uint32_t deadline);
+
+#endif
+
+#endif // KEYS_DMA_H
@@ -0,0 +1,110 @@
+/**
+ * Copyright (C) 2019, Sergey Shcherbakov
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ *
+ *
+ * @brief Minimalistic cooperative scheduler for drivers
+ *
+ * Every tick tasks are run in array order, so the first tasks have the
+ * highest priority. Each run gets a deadline - minimum of the task budget
+ * and the rest of the tick budget - and should return by it. Usage:
+ *
+ *   struct sched_task_s tasks[] = {
+ *     { .name = "keys", .step = keys_task, .ctx = &poll, .period = 1000, .budget = 50 },
+ *     { .name = "lcd", .step = hd44780_task, .budget = 400 },
+ *   };
+ *   struct sched_s sched = { .tasks = tasks, .num_tasks = 2, .tick = 500, .budget = 450 };
+ *
+ *   hd44780_set_deferred(true);
+ *   sched_run(&sched);
+ */
+
+#ifndef SCHED_H
+#define SCHED_H
+
+// Std headers
+#include <stdint.h>
+#include <stdbool.h>
+
+/// Descriptor of task
+struct sched_task_s {
+	/// Task name
+	const char *name;
+	/// Non-blocking step, should return by deadline (micros() time)
+	void (*step)(void *ctx, uint32_t deadline);
+	/// Step context
+	void *ctx;
+	/// Period in microseconds, 0 to run every tick
+	uint32_t period;
+	/// Max time of one run in microseconds
+	uint32_t budget;
+
+	/* Filled by scheduler */
+	/// Time of next release
+	uint32_t release;
+	/// Number of runs
+	uint32_t runs;
+	/// Number of runs finished after deadline
+	uint32_t overruns;
+	/// Number of releases skipped because tick budget was exhausted
+	uint32_t skipped;
+	/// Max delay between release and start, us
+	uint32_t max_jitter;
+	/// Max run time, us
+	uint32_t max_time;
+};
+
+/// Descriptor of scheduler
+struct sched_s {
+	/// Array of tasks, sorted by priority
+	struct sched_task_s *tasks;
+	/// Number of tasks
+	uint8_t num_tasks;
+	/// Tick period in microseconds
+	uint32_t tick;
+	/// Time budget of all tasks in tick, us
+	uint32_t budget;
+
+	/* Filled by scheduler */
+	/// Time of next tick
+	uint32_t next;
+	/// Number of ticks
+	uint32_t ticks;
+	/// Number of ticks finished after tick budget
+	uint32_t overruns;
+	/// Max delay of tick start, us
+	uint32_t max_jitter;
+};
+
+/**
+ * @brief Reset scheduler statistics and release all tasks now
+ * @param	sched	Scheduler descriptor
+ */
+void sched_init(struct sched_s *sched);
+
+/**
+ * @brief Run one tick if it's time, non-blocking
+ * @param	sched	Scheduler descriptor
+ * @return	True if tick has been run
+ */
+bool sched_tick(struct sched_s *sched);
+
+/**
+ * @brief Run scheduler forever
+ * @param	sched	Scheduler descriptor
+ */
+void sched_run(struct sched_s *sched);
+
+#endif // SCHED_H
@@ -25,32 +25,37 @@
 #include "include/keys.h"
 #include "include/helper.h"
 
-void keys_setup(struct keys_s *keys, int n)
+int keys_setup(struct keys_s *keys, int n)
 {
-	volatile int id;
+	int id;
+	int ret;
 	uint8_t pullup;
 
-	// Configuring buttons array
+	// Claiming buttons array, pins are configured in batch per port
 	for (id = 0; id < n; id++) {
-		// Enable clock on port
-		rcc_periph_clock_enable(port2RCC(keys[id].port));
-
 		if (keys[id].pup) {
 			pullup = GPIO_PUPD_PULLUP;
 		} else {
 			pullup = GPIO_PUPD_NONE;
 		}
 
-		// Configure pin as input
-		gpio_mode_setup(
+		// Configure pin as input with pull-up
+		ret = gpio_res_claim(
 				keys[id].port,
+				keys[id].gpio,
 				GPIO_MODE_INPUT,
 				pullup,
-				keys[id].gpio);
-
-		// Enable pull-up
-		gpio_set(keys[id].port, keys[id].gpio);
+				true,
+				GPIO_RES_OWNER_KEYS);
+		if (ret < 0) {
+			gpio_res_abort();
+			return ret;
+		}
 	}
+
+	gpio_res_commit();
+
+	return GPIO_RES_OK;
 }
 
 bool key_pressed(struct keys_s *keys, int id)
@@ -58,3 +63,193 @@ bool key_pressed(struct keys_s *keys, int id)
 	bool val = !gpio_get(keys[id].port, keys[id].gpio);
 	return val ^ keys[id].nc;
 }
+
+keys_mask_t keys_read(struct keys_s *keys, int n)
+{
+	keys_mask_t mask = 0;
+	int id;
+
+	// Keys past the bitmask can't be reported
+	if (n > KEYS_MASK_BITS) {
+		n = KEYS_MASK_BITS;
+	}
+
+	for (id = 0; id < n; id++) {
+		if (key_pressed(keys, id)) {
+			mask |= (keys_mask_t)1 << id;
+		}
+	}
+
+	return mask;
+}
+
+/// Time for column lines to settle after row switching, us
+#ifndef KEYS_MATRIX_SETTLE_US
+#define KEYS_MATRIX_SETTLE_US (2)
+#endif
+
+/// Delay to let column lines settle after row switching; released column
+/// is pulled up by weak internal pull-up, so it takes about 1 us
+#ifndef KEYS_MATRIX_SETTLE
+#define KEYS_MATRIX_SETTLE() sleep_us(KEYS_MATRIX_SETTLE_US)
+#endif
+
+int keys_matrix_setup(struct keys_matrix_s *matrix)
+{
+	uint8_t i;
+	uint8_t pullup;
+	int ret;
+
+	// Shifts by row offset should stay inside keys bitmask
+	if (!matrix->num_rows || !matrix->num_cols ||
+			matrix->num_rows > KEYS_MATRIX_MAX_ROWS || matrix->num_cols > 16 ||
+			matrix->num_rows * matrix->num_cols + matrix->first_bit > KEYS_MASK_BITS) {
+		return KEYS_ERR_SIZE;
+	}
+
+	matrix->row_mask = 0;
+	for (i = 0; i < matrix->num_rows; i++) {
+		matrix->row_mask |= matrix->rows[i];
+		matrix->row_state[i] = 0;
+	}
+
+	matrix->col_mask = 0;
+	for (i = 0; i < matrix->num_cols; i++) {
+		matrix->col_mask |= matrix->cols[i];
+	}
+
+	// Adjacent ascending columns are converted by single shift
+	matrix->col_shift = __builtin_ctz(matrix->cols[0]);
+	matrix->col_linear = true;
+	for (i = 0; i < matrix->num_cols; i++) {
+		if (matrix->cols[i] != (1u << (matrix->col_shift + i))) {
+			matrix->col_linear = false;
+			break;
+		}
+	}
+
+	matrix->last = 0;
+
+	if (matrix->pup) {
+		pullup = GPIO_PUPD_PULLUP;
+	} else {
+		pullup = GPIO_PUPD_NONE;
+	}
+
+	// Rows are open-drain and released (high) while idle
+	ret = gpio_res_claim(matrix->row_port, matrix->row_mask, GPIO_MODE_OUTPUT, GPIO_PUPD_NONE, true, GPIO_RES_OWNER_KEYS);
+	if (ret == GPIO_RES_OK) {
+		ret = gpio_res_claim(matrix->col_port, matrix->col_mask, GPIO_MODE_INPUT, pullup, true, GPIO_RES_OWNER_KEYS);
+	}
+
+	if (ret < 0) {
+		gpio_res_abort();
+		return ret;
+	}
+
+	// Rows become open-drain before commit drives them, so a pressed key
+	// never shorts two push-pull rows; port clock is needed for that
+	gpio_res_clock_get(matrix->row_port);
+	gpio_set_output_options(matrix->row_port, GPIO_OTYPE_OD, GPIO_OSPEED_2MHZ, matrix->row_mask);
+	gpio_res_commit();
+	gpio_res_clock_put(matrix->row_port);
+
+	return GPIO_RES_OK;
+}
+
+/**
+ * @brief Convert port value to columns bitmask
+ * @param	matrix	Keys matrix descriptor
+ * @param	val	Port value, set bits are pressed
+ * @return	Columns bitmask, bit N is column N
+ */
+static uint16_t keys_matrix_cols(struct keys_matrix_s *matrix, uint16_t val)
+{
+	uint16_t cols = 0;
+	uint8_t i;
+
+	if (matrix->col_linear) {
+		return val >> matrix->col_shift;
+	}
+
+	for (i = 0; i < matrix->num_cols; i++) {
+		if (val & matrix->cols[i]) {
+			cols |= 1u << i;
+		}
+	}
+
+	return cols;
+}
+
+bool keys_matrix_scan(struct keys_matrix_s *matrix, keys_mask_t *mask)
+{
+	keys_mask_t state = 0;
+	keys_mask_t row_bits;
+	uint16_t ghost_rows = 0;
+	uint16_t common;
+	uint16_t val;
+	uint8_t r, q;
+
+	for (r = 0; r < matrix->num_rows; r++) {
+		gpio_clear(matrix->row_port, matrix->rows[r]);
+		KEYS_MATRIX_SETTLE();
+		val = ~gpio_port_read(matrix->col_port) & matrix->col_mask;
+		gpio_set(matrix->row_port, matrix->rows[r]);
+		// Released columns should recover before next row is read
+		KEYS_MATRIX_SETTLE();
+
+		matrix->row_state[r] = keys_matrix_cols(matrix, val);
+	}
+
+	// Two rows sharing two or more columns form a rectangle - one of its
+	// corners can be a ghost and the real state of it is masked
+	for (r = 0; r < matrix->num_rows; r++) {
+		for (q = r + 1; q < matrix->num_rows; q++) {
+			common = matrix->row_state[r] & matrix->row_state[q];
+			if (common & (common - 1)) {
+				ghost_rows |= (1u << r) | (1u << q);
+			}
+		}
+	}
+
+	row_bits = ((keys_mask_t)1 << matrix->num_cols) - 1;
+	for (r = 0; r < matrix->num_rows; r++) {
+		if (ghost_rows & (1u << r)) {
+			state |= matrix->last & (row_bits << (r * matrix->num_cols));
+		} else {
+			state |= (keys_mask_t)matrix->row_state[r] << (r * matrix->num_cols);
+		}
+	}
+
+	matrix->last = state;
+	*mask |= state << matrix->first_bit;
+
+	return ghost_rows != 0;
+}
+
+void keys_poll(struct keys_poll_s *poll)
+{
+	keys_mask_t state = 0;
+	keys_mask_t changed;
+
+	if (poll->keys) {
+		state = keys_read(poll->keys, poll->num_keys);
+	}
+
+	if (poll->matrix) {
+		keys_matrix_scan(poll->matrix, &state);
+	}
+
+	changed = state ^ poll->state;
+	poll->pressed |= changed & state;
+	poll->released |= changed & ~state;
+	poll->state = state;
+	poll->timestamp = micros();
+}
+
+void keys_task(void *ctx, uint32_t deadline)
+{
+	(void)deadline;
+
+	keys_poll((struct keys_poll_s *)ctx);
+}
@@ -0,0 +1,169 @@
+/**
+ * Copyright (C) 2019, Sergey Shcherbakov
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Std headers
+#include <stddef.h>
+
+// Local headers
+#include "include/keys_adc.h"
+
+/**
+ * @brief Check if sample is in window
+ * @param	win		Voltage window
+ * @param	margin	Window is widened by margin
+ * @param	sample	ADC sample
+ * @return	True if sample is in window
+ */
+static bool keys_adc_in(const struct keys_adc_window *win, uint16_t margin, uint16_t sample)
+{
+	uint16_t lo = (win->lo > margin) ? win->lo - margin : 0;
+
+	return sample >= lo && sample <= (uint32_t)win->hi + margin;
+}
+
+void keys_adc_reset(struct keys_ladder_s *ladders, uint8_t n)
+{
+	uint8_t i;
+
+	for (i = 0; i < n; i++) {
+		ladders[i].pressed = KEYS_ADC_NONE;
+	}
+}
+
+keys_mask_t keys_adc_decode(struct keys_ladder_s *ladders, uint8_t n, const volatile uint16_t *samples)
+{
+	keys_mask_t mask = 0;
+	struct keys_ladder_s *ladder;
+	uint16_t sample;
+	uint8_t i, k;
+
+	for (i = 0; i < n; i++) {
+		ladder = &ladders[i];
+		sample = samples[i];
+
+		// Pressed key is kept while sample is in widened window
+		if (ladder->pressed == KEYS_ADC_NONE ||
+				!keys_adc_in(&ladder->windows[ladder->pressed], ladder->hysteresis, sample)) {
+			ladder->pressed = KEYS_ADC_NONE;
+
+			for (k = 0; k < ladder->num_keys; k++) {
+				if (keys_adc_in(&ladder->windows[k], 0, sample)) {
+					ladder->pressed = k;
+					break;
+				}
+			}
+		}
+
+		if (ladder->pressed != KEYS_ADC_NONE) {
+			mask |= (keys_mask_t)1 << (ladder->first_bit + ladder->pressed);
+		}
+	}
+
+	return mask;
+}
+
+#if defined(STM32F2) || defined(STM32F4) || defined(STM32F7)
+
+// libopencm3 headers
+#include <libopencm3/stm32/adc.h>
+#include <libopencm3/stm32/dma.h>
+
+// Local headers
+#include "include/helper.h"
+
+/* ADC and DMA used for ladders, ADC1 is served by DMA2 stream 0 channel 0 */
+#ifndef KEYS_ADC
+#define KEYS_ADC                ADC1
+#define KEYS_ADC_RCC            RCC_ADC1
+#endif
+
+/// ADC stabilization time after power-on (tSTAB), us
+#ifndef KEYS_ADC_STAB_US
+#define KEYS_ADC_STAB_US        (3)
+#endif
+
+#ifndef KEYS_ADC_DMA
+#define KEYS_ADC_DMA            DMA2
+#define KEYS_ADC_DMA_RCC        RCC_DMA2
+#define KEYS_ADC_DMA_STREAM     DMA_STREAM0
+#define KEYS_ADC_DMA_CHANNEL    DMA_SxCR_CHSEL_0
+#endif
+
+int keys_adc_setup(struct keys_ladder_s *ladders, uint8_t n, volatile uint16_t *samples)
+{
+	uint8_t channels[16];
+	uint8_t i;
+	int ret;
+
+	// Regular sequence holds up to 16 conversions
+	if (!n || n > sizeof(channels)) {
+		return KEYS_ERR_SIZE;
+	}
+
+	// Keys of every ladder should fit keys bitmask
+	for (i = 0; i < n; i++) {
+		if (!ladders[i].num_keys || ladders[i].first_bit + ladders[i].num_keys > KEYS_MASK_BITS) {
+			return KEYS_ERR_SIZE;
+		}
+	}
+
+	keys_adc_reset(ladders, n);
+
+	for (i = 0; i < n; i++) {
+		channels[i] = ladders[i].channel;
+
+		ret = gpio_res_claim(ladders[i].port, ladders[i].gpio, GPIO_MODE_ANALOG, GPIO_PUPD_NONE, false, GPIO_RES_OWNER_KEYS);
+		if (ret < 0) {
+			gpio_res_abort();
+			return ret;
+		}
+	}
+
+	gpio_res_commit();
+
+	rcc_periph_clock_enable(KEYS_ADC_DMA_RCC);
+	rcc_periph_clock_enable(KEYS_ADC_RCC);
+
+	// One DMA transfer per conversion, wraps after the whole sequence
+	dma_stream_reset(KEYS_ADC_DMA, KEYS_ADC_DMA_STREAM);
+	dma_channel_select(KEYS_ADC_DMA, KEYS_ADC_DMA_STREAM, KEYS_ADC_DMA_CHANNEL);
+	dma_set_priority(KEYS_ADC_DMA, KEYS_ADC_DMA_STREAM, DMA_SxCR_PL_LOW);
+	dma_set_transfer_mode(KEYS_ADC_DMA, KEYS_ADC_DMA_STREAM, DMA_SxCR_DIR_PERIPHERAL_TO_MEM);
+	dma_set_peripheral_size(KEYS_ADC_DMA, KEYS_ADC_DMA_STREAM, DMA_SxCR_PSIZE_16BIT);
+	dma_set_memory_size(KEYS_ADC_DMA, KEYS_ADC_DMA_STREAM, DMA_SxCR_MSIZE_16BIT);
+	dma_enable_memory_increment_mode(KEYS_ADC_DMA, KEYS_ADC_DMA_STREAM);
+	dma_enable_circular_mode(KEYS_ADC_DMA, KEYS_ADC_DMA_STREAM);
+	dma_set_peripheral_address(KEYS_ADC_DMA, KEYS_ADC_DMA_STREAM, (uint32_t)&ADC_DR(KEYS_ADC));
+	dma_set_memory_address(KEYS_ADC_DMA, KEYS_ADC_DMA_STREAM, (uint32_t)samples);
+	dma_set_number_of_data(KEYS_ADC_DMA, KEYS_ADC_DMA_STREAM, n);
+	dma_enable_stream(KEYS_ADC_DMA, KEYS_ADC_DMA_STREAM);
+
+	// Continuous scan of all ladders, long sampling for high-impedance ladders
+	adc_power_off(KEYS_ADC);
+	adc_enable_scan_mode(KEYS_ADC);
+	adc_set_continuous_conversion_mode(KEYS_ADC);
+	adc_set_sample_time_on_all_channels(KEYS_ADC, ADC_SMPR_SMP_480CYC);
+	adc_set_regular_sequence(KEYS_ADC, n, channels);
+	adc_enable_dma(KEYS_ADC);
+	adc_set_dma_continue(KEYS_ADC);
+	adc_power_on(KEYS_ADC);
+	sleep_us(KEYS_ADC_STAB_US);
+	adc_start_conversion_regular(KEYS_ADC);
+
+	return GPIO_RES_OK;
+}
+
+#endif
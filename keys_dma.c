@@ -0,0 +1,144 @@
+/**
+ * Copyright (C) 2019, Sergey Shcherbakov
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Std headers
+#include <stddef.h>
+
+// Local headers
+#include "include/keys_dma.h"
+
+void keys_debounce_setup(struct keys_debounce_s *db, const struct keys_s *keys, int n, uint32_t port)
+{
+	int id;
+
+	db->pins = 0;
+	db->active_low = 0;
+	db->cnt0 = 0;
+	db->cnt1 = 0;
+	db->state = 0;
+	db->pressed = 0;
+	db->released = 0;
+
+	// Same polarity as key_pressed()
+	for (id = 0; id < n; id++) {
+		if (keys[id].port != port) {
+			continue;
+		}
+
+		db->pins |= keys[id].gpio;
+		if (!keys[id].nc) {
+			db->active_low |= keys[id].gpio;
+		}
+	}
+}
+
+void keys_debounce(struct keys_debounce_s *db, const volatile uint16_t *samples, size_t n)
+{
+	uint16_t pressed, delta, toggle;
+	size_t i;
+
+	for (i = 0; i < n; i++) {
+		pressed = (samples[i] ^ db->active_low) & db->pins;
+
+		// 2-bit vertical counter, state toggles on 4th differing sample
+		delta = pressed ^ db->state;
+		db->cnt1 = (db->cnt1 ^ db->cnt0) & delta;
+		db->cnt0 = ~db->cnt0 & delta;
+		toggle = delta & ~(db->cnt0 | db->cnt1);
+
+		db->state ^= toggle;
+		db->pressed |= toggle & db->state;
+		db->released |= toggle & ~db->state;
+	}
+}
+
+keys_mask_t keys_debounce_mask(const struct keys_s *keys, int n, uint32_t port, uint16_t pins)
+{
+	keys_mask_t mask = 0;
+	int id;
+
+	for (id = 0; id < n; id++) {
+		if (keys[id].port == port && (pins & keys[id].gpio)) {
+			mask |= (keys_mask_t)1 << id;
+		}
+	}
+
+	return mask;
+}
+
+#if defined(STM32F2) || defined(STM32F4) || defined(STM32F7)
+
+// libopencm3 headers
+#include <libopencm3/stm32/rcc.h>
+#include <libopencm3/stm32/gpio.h>
+#include <libopencm3/stm32/timer.h>
+#include <libopencm3/stm32/dma.h>
+
+void keys_dma_setup(struct keys_dma_s *sampler)
+{
+	keys_debounce_setup(&sampler->debounce, sampler->keys, sampler->num_keys, sampler->port);
+	sampler->tail = 0;
+
+	rcc_periph_clock_enable(sampler->dma_rcc);
+	rcc_periph_clock_enable(sampler->timer_rcc);
+
+	// Input register is copied on every timer update
+	dma_stream_reset(sampler->dma, sampler->stream);
+	dma_channel_select(sampler->dma, sampler->stream, sampler->channel);
+	dma_set_priority(sampler->dma, sampler->stream, DMA_SxCR_PL_LOW);
+	dma_set_transfer_mode(sampler->dma, sampler->stream, DMA_SxCR_DIR_PERIPHERAL_TO_MEM);
+	dma_set_peripheral_size(sampler->dma, sampler->stream, DMA_SxCR_PSIZE_16BIT);
+	dma_set_memory_size(sampler->dma, sampler->stream, DMA_SxCR_MSIZE_16BIT);
+	dma_enable_memory_increment_mode(sampler->dma, sampler->stream);
+	dma_enable_circular_mode(sampler->dma, sampler->stream);
+	dma_set_peripheral_address(sampler->dma, sampler->stream, (uint32_t)&GPIO_IDR(sampler->port));
+	dma_set_memory_address(sampler->dma, sampler->stream, (uint32_t)sampler->buffer);
+	dma_set_number_of_data(sampler->dma, sampler->stream, sampler->size);
+	dma_enable_stream(sampler->dma, sampler->stream);
+
+	// 1 MHz timer clock, update at sampling rate
+	timer_set_prescaler(sampler->timer, sampler->timer_clock / 1000000 - 1);
+	timer_set_period(sampler->timer, 1000000 / sampler->rate - 1);
+	timer_enable_irq(sampler->timer, TIM_DIER_UDE);
+	timer_enable_counter(sampler->timer);
+}
+
+void keys_dma_poll(struct keys_dma_s *sampler)
+{
+	uint16_t head = sampler->size - dma_get_number_of_data(sampler->dma, sampler->stream);
+
+	if (head >= sampler->size) {
+		head = 0;
+	}
+
+	// Buffer wrapped since last poll
+	if (head < sampler->tail) {
+		keys_debounce(&sampler->debounce, &sampler->buffer[sampler->tail], sampler->size - sampler->tail);
+		sampler->tail = 0;
+	}
+
+	keys_debounce(&sampler->debounce, &sampler->buffer[sampler->tail], head - sampler->tail);
+	sampler->tail = head;
+}
+
+void keys_dma_task(void *ctx, uint32_t deadline)
+{
+	(void)deadline;
+
+	keys_dma_poll((struct keys_dma_s *)ctx);
+}
+
+#endif
@@ -0,0 +1,134 @@
+/**
+ * Copyright (C) 2019, Sergey Shcherbakov
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Std headers
+#include <stddef.h>
+
+// Local headers
+#include "include/helper.h"
+#include "include/sched.h"
+
+void sched_init(struct sched_s *sched)
+{
+	uint32_t now = micros();
+	uint8_t i;
+
+	sched->next = now;
+	sched->ticks = 0;
+	sched->overruns = 0;
+	sched->max_jitter = 0;
+
+	for (i = 0; i < sched->num_tasks; i++) {
+		sched->tasks[i].release = now;
+		sched->tasks[i].runs = 0;
+		sched->tasks[i].overruns = 0;
+		sched->tasks[i].skipped = 0;
+		sched->tasks[i].max_jitter = 0;
+		sched->tasks[i].max_time = 0;
+	}
+}
+
+/**
+ * @brief Run task if it's released
+ * @param	task		Task descriptor
+ * @param	tick_end	End of tick budget
+ */
+static void sched_run_task(struct sched_task_s *task, uint32_t tick_end)
+{
+	uint32_t start = micros();
+	uint32_t deadline;
+	uint32_t time;
+
+	if (task->period && TIME_BEFORE(start, task->release)) {
+		return;
+	}
+
+	// Tick budget is exhausted - try on next tick
+	if (!TIME_BEFORE(start, tick_end)) {
+		task->skipped++;
+		return;
+	}
+
+	if (task->period && start - task->release > task->max_jitter) {
+		task->max_jitter = start - task->release;
+	}
+
+	deadline = start + task->budget;
+	if (TIME_BEFORE(tick_end, deadline)) {
+		deadline = tick_end;
+	}
+
+	task->step(task->ctx, deadline);
+
+	time = micros() - start;
+	if (time > task->max_time) {
+		task->max_time = time;
+	}
+	if (TIME_BEFORE(deadline, start + time)) {
+		task->overruns++;
+	}
+	task->runs++;
+
+	if (task->period) {
+		task->release += task->period;
+		// Too late - don't try to catch up missed releases
+		if (TIME_BEFORE(task->release, start)) {
+			task->release = start + task->period;
+		}
+	}
+}
+
+bool sched_tick(struct sched_s *sched)
+{
+	uint32_t start = micros();
+	uint32_t tick_end;
+	uint8_t i;
+
+	if (TIME_BEFORE(start, sched->next)) {
+		return false;
+	}
+
+	if (start - sched->next > sched->max_jitter) {
+		sched->max_jitter = start - sched->next;
+	}
+
+	tick_end = start + sched->budget;
+
+	for (i = 0; i < sched->num_tasks; i++) {
+		sched_run_task(&sched->tasks[i], tick_end);
+	}
+
+	if (TIME_BEFORE(tick_end, micros())) {
+		sched->overruns++;
+	}
+	sched->ticks++;
+
+	sched->next += sched->tick;
+	if (TIME_BEFORE(sched->next, start)) {
+		sched->next = start + sched->tick;
+	}
+
+	return true;
+}
+
+void sched_run(struct sched_s *sched)
+{
+	sched_init(sched);
+
+	while (true) {
+		sched_tick(sched);
+	}
+}
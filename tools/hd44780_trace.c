@@ -0,0 +1,245 @@
+/**
+ * Copyright (C) 2019, Sergey Shcherbakov
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ *
+ *
+ * @brief Host tool converting HD44780 bus trace dump into VCD and
+ * annotated instruction listing
+ *
+ * Build: cc -o hd44780_trace tools/hd44780_trace.c
+ * Usage: hd44780_trace -f ticks_per_second [-o trace.vcd] dump.txt
+ *
+ * Dump is an output of hd44780_trace_dump(), lines not starting with "T "
+ * are ignored. Listing is printed to stdout. Timestamp rate is required,
+ * it's the core clock with default HD44780_TRACE_TIMESTAMP() (DWT cycles).
+ */
+
+// Std headers
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+// Local headers
+#include "../include/hd44780.h"
+
+/// E pulse width shown in VCD, ns
+#define E_PULSE_NS 1000
+
+static const char *op_names[] = {
+	[HD44780_OP_CLEAR] = "CLEAR DISPLAY",
+	[HD44780_OP_HOME] = "RETURN HOME",
+	[HD44780_OP_ENTRY_MODE] = "ENTRY MODE SET",
+	[HD44780_OP_DISPLAY_CTRL] = "DISPLAY CONTROL",
+	[HD44780_OP_SHIFT] = "CURSOR/DISPLAY SHIFT",
+	[HD44780_OP_FUNCTION_SET] = "FUNCTION SET",
+	[HD44780_OP_CGRAM_ADDR] = "SET CGRAM ADDR",
+	[HD44780_OP_DDRAM_ADDR] = "SET DDRAM ADDR",
+	[HD44780_OP_DATA] = "WRITE DATA",
+	[HD44780_OP_BUSY] = "READ BUSY/AC",
+	[HD44780_OP_READ] = "READ DATA",
+	[HD44780_OP_NIBBLE] = "HALF-BYTE",
+};
+
+struct entry {
+	uint64_t ns;
+	unsigned int flags;
+	unsigned int data;
+	unsigned int op;
+	unsigned int displays;
+};
+
+static void usage(const char *name)
+{
+	fprintf(stderr, "Usage: %s -f ticks_per_second [-o trace.vcd] dump.txt\n", name);
+	exit(1);
+}
+
+/**
+ * @brief Print annotation of instruction arguments
+ */
+static void annotate(const struct entry *e)
+{
+	unsigned int d = e->data;
+
+	switch (e->op) {
+		case HD44780_OP_ENTRY_MODE:
+			printf(" I/D=%u S=%u", !!(d & 0x02), !!(d & 0x01));
+			break;
+		case HD44780_OP_DISPLAY_CTRL:
+			printf(" D=%u C=%u B=%u", !!(d & 0x04), !!(d & 0x02), !!(d & 0x01));
+			break;
+		case HD44780_OP_SHIFT:
+			printf(" %s %s", (d & 0x08) ? "display" : "cursor", (d & 0x04) ? "right" : "left");
+			break;
+		case HD44780_OP_FUNCTION_SET:
+			printf(" DL=%u N=%u F=%u", !!(d & 0x10), !!(d & 0x08), !!(d & 0x04));
+			break;
+		case HD44780_OP_CGRAM_ADDR:
+			printf(" 0x%02x (char %u row %u)", d & 0x3F, (d & 0x3F) >> 3, d & 0x07);
+			break;
+		case HD44780_OP_DDRAM_ADDR:
+			printf(" 0x%02x", d & 0x7F);
+			break;
+		case HD44780_OP_DATA:
+		case HD44780_OP_READ:
+			if (d >= 0x20 && d < 0x7F) {
+				printf(" '%c'", d);
+			}
+			break;
+		case HD44780_OP_BUSY:
+			printf(" BF=%u AC=0x%02x", !!(d & 0x80), d & 0x7F);
+			break;
+		default:
+			break;
+	}
+}
+
+static void vcd_header(FILE *vcd)
+{
+	fprintf(vcd, "$timescale 1ns $end\n");
+	fprintf(vcd, "$scope module hd44780 $end\n");
+	fprintf(vcd, "$var wire 1 r rs $end\n");
+	fprintf(vcd, "$var wire 1 w rnw $end\n");
+	fprintf(vcd, "$var wire 1 e e $end\n");
+	fprintf(vcd, "$var wire 8 d db $end\n");
+	fprintf(vcd, "$var wire 4 o op $end\n");
+	fprintf(vcd, "$var wire 4 s displays $end\n");
+	fprintf(vcd, "$upscope $end\n");
+	fprintf(vcd, "$enddefinitions $end\n");
+	fprintf(vcd, "$dumpvars\n0r\n0w\n0e\nb0 d\nb0 o\nb0 s\n$end\n");
+}
+
+static void vcd_bits(FILE *vcd, unsigned int val, int width, char id)
+{
+	int i;
+
+	fputc('b', vcd);
+	for (i = width - 1; i >= 0; i--) {
+		fputc((val >> i) & 1 ? '1' : '0', vcd);
+	}
+	fprintf(vcd, " %c\n", id);
+}
+
+/// Time of pending falling edge of E, 0 if none
+static uint64_t e_fall;
+
+static void vcd_entry(FILE *vcd, const struct entry *e)
+{
+	// Half-byte is driven on DB7..DB4
+	unsigned int db = (e->flags & HD44780_TRACE_NIBBLE) ? e->data << 4 : e->data;
+
+	// Keep time monotonic if entries are closer than E pulse
+	if (e_fall && e_fall < e->ns) {
+		fprintf(vcd, "#%llu\n0e\n", (unsigned long long)e_fall);
+		fprintf(vcd, "#%llu\n", (unsigned long long)e->ns);
+	} else {
+		fprintf(vcd, "#%llu\n", (unsigned long long)e->ns);
+		if (e_fall) {
+			fprintf(vcd, "0e\n");
+		}
+	}
+
+	fprintf(vcd, "%cr\n", (e->flags & HD44780_TRACE_RS) ? '1' : '0');
+	fprintf(vcd, "%cw\n", (e->flags & HD44780_TRACE_RNW) ? '1' : '0');
+	vcd_bits(vcd, db, 8, 'd');
+	vcd_bits(vcd, e->op & 0x0F, 4, 'o');
+	vcd_bits(vcd, e->displays, 4, 's');
+	fprintf(vcd, "1e\n");
+	e_fall = e->ns + E_PULSE_NS;
+}
+
+int main(int argc, char *argv[])
+{
+	const char *vcd_name = NULL;
+	const char *dump_name = NULL;
+	double ticks_per_second = 0;
+	FILE *dump, *vcd = NULL;
+	char line[128];
+	unsigned long ts, prev_ts = 0;
+	uint64_t ticks = 0;
+	struct entry e;
+	unsigned long n = 0;
+	int i;
+
+	for (i = 1; i < argc; i++) {
+		if (!strcmp(argv[i], "-f") && i + 1 < argc) {
+			ticks_per_second = atof(argv[++i]);
+		} else if (!strcmp(argv[i], "-o") && i + 1 < argc) {
+			vcd_name = argv[++i];
+		} else if (argv[i][0] != '-' && !dump_name) {
+			dump_name = argv[i];
+		} else {
+			usage(argv[0]);
+		}
+	}
+
+	if (!dump_name || ticks_per_second <= 0) {
+		usage(argv[0]);
+	}
+
+	dump = fopen(dump_name, "r");
+	if (!dump) {
+		perror(dump_name);
+		return 1;
+	}
+
+	if (vcd_name) {
+		vcd = fopen(vcd_name, "w");
+		if (!vcd) {
+			perror(vcd_name);
+			return 1;
+		}
+		vcd_header(vcd);
+	}
+
+	while (fgets(line, sizeof(line), dump)) {
+		if (sscanf(line, "T %lx %x %x %x %x", &ts, &e.flags, &e.data, &e.op, &e.displays) != 5) {
+			continue;
+		}
+
+		// 32-bit timestamp wraps around
+		if (n) {
+			ticks += (uint32_t)(ts - prev_ts);
+		}
+		prev_ts = ts;
+		n++;
+
+		e.ns = (uint64_t)(ticks * 1e9 / ticks_per_second);
+
+		printf("%12.3f us  RS=%u RnW=%u  0x%02x  %s", e.ns / 1000.0,
+				!!(e.flags & HD44780_TRACE_RS), !!(e.flags & HD44780_TRACE_RNW),
+				e.data, (e.op < sizeof(op_names) / sizeof(op_names[0]) && op_names[e.op]) ? op_names[e.op] : "?");
+		annotate(&e);
+		if (e.displays != 0x01) {
+			printf("  [displays 0x%x]", e.displays);
+		}
+		printf("\n");
+
+		if (vcd) {
+			vcd_entry(vcd, &e);
+		}
+	}
+
+	fclose(dump);
+	if (vcd) {
+		if (e_fall) {
+			fprintf(vcd, "#%llu\n0e\n", (unsigned long long)e_fall);
+		}
+		fclose(vcd);
+	}
+
+	return 0;
+}
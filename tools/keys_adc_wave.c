@@ -0,0 +1,209 @@
+/**
+ * Copyright (C) 2019, Sergey Shcherbakov
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ *
+ *
+ * @brief Host stand-in of ADC feeding sampled waveforms to keys_adc_decode()
+ *
+ * Build: cc -o keys_adc_wave tools/keys_adc_wave.c keys_adc.c
+ * Usage: keys_adc_wave -w lo:hi [-w lo:hi ...] [-y hysteresis] [samples.txt]
+ *
+ * Every line of samples file is one scan: samples of all ladders separated
+ * by spaces, ladders share the same windows. Without file a waveform of a
+ * single ladder is synthesized: every key is pressed and released in turn
+ * with contact bounce and noise. Changes of keys bitmask are printed to
+ * stdout.
+ */
+
+// Std headers
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+// Local headers
+#include "../include/keys_adc.h"
+
+/// Max number of keys per ladder and ladders per scan
+#define MAX_KEYS 16
+#define MAX_LADDERS 16
+
+/// ADC full scale - no key pressed, ladder pulled up
+#define ADC_IDLE 4095
+/// Amplitude of synthesized noise, ADC counts
+#define NOISE 12
+/// Synthesized scans per phase of key press
+#define PHASE_SCANS 20
+/// Synthesized bounce scans on press and release
+#define BOUNCE_SCANS 6
+
+static uint32_t lcg = 1;
+
+static void usage(const char *name)
+{
+	fprintf(stderr, "Usage: %s -w lo:hi [-w lo:hi ...] [-y hysteresis] [samples.txt]\n", name);
+	exit(1);
+}
+
+/**
+ * @brief Pseudo-random noise, repeatable between runs
+ * @return	Noise, -NOISE..NOISE
+ */
+static int noise(void)
+{
+	lcg = lcg * 1103515245u + 12345u;
+
+	return (int)((lcg >> 16) % (2 * NOISE + 1)) - NOISE;
+}
+
+/**
+ * @brief Clamp value to ADC range
+ * @param	val	Value
+ * @return	Sample
+ */
+static uint16_t adc_clamp(int val)
+{
+	if (val < 0) {
+		return 0;
+	}
+
+	return (val > ADC_IDLE) ? ADC_IDLE : (uint16_t)val;
+}
+
+/**
+ * @brief Decode one scan and print keys bitmask if it changed
+ * @param	ladders	Array of ladders descriptors
+ * @param	n		Number of ladders
+ * @param	samples	Samples of scan
+ * @param	scan	Scan number
+ * @param	last	Last keys bitmask
+ */
+static void feed(struct keys_ladder_s *ladders, uint8_t n, const uint16_t *samples,
+		unsigned long scan, keys_mask_t *last)
+{
+	keys_mask_t mask = keys_adc_decode(ladders, n, samples);
+
+	if (mask != *last) {
+		printf("%8lu %016llx\n", scan, (unsigned long long)mask);
+		*last = mask;
+	}
+}
+
+int main(int argc, char **argv)
+{
+	struct keys_adc_window windows[MAX_KEYS];
+	struct keys_ladder_s ladders[MAX_LADDERS];
+	uint16_t samples[MAX_LADDERS];
+	const char *name = NULL;
+	unsigned int lo, hi;
+	unsigned long scan = 0;
+	keys_mask_t last = 0;
+	uint16_t hysteresis = 0;
+	uint8_t num_keys = 0;
+	uint8_t n = 1;
+	uint8_t i, k;
+	int j, level;
+	char line[512];
+	char *p, *end;
+	FILE *f;
+
+	for (j = 1; j < argc; j++) {
+		if (!strcmp(argv[j], "-w") && j + 1 < argc) {
+			if (num_keys == MAX_KEYS || sscanf(argv[++j], "%u:%u", &lo, &hi) != 2 || lo > hi) {
+				usage(argv[0]);
+			}
+			windows[num_keys].lo = lo;
+			windows[num_keys].hi = hi;
+			num_keys++;
+		} else if (!strcmp(argv[j], "-y") && j + 1 < argc) {
+			hysteresis = atoi(argv[++j]);
+		} else if (argv[j][0] != '-' && !name) {
+			name = argv[j];
+		} else {
+			usage(argv[0]);
+		}
+	}
+
+	if (!num_keys) {
+		usage(argv[0]);
+	}
+
+	for (i = 0; i < MAX_LADDERS; i++) {
+		ladders[i].windows = windows;
+		ladders[i].num_keys = num_keys;
+		ladders[i].hysteresis = hysteresis;
+		ladders[i].first_bit = i * num_keys;
+	}
+	keys_adc_reset(ladders, MAX_LADDERS);
+
+	if (!name) {
+		// Idle, bounce, hold, bounce, idle for every key
+		for (k = 0; k < num_keys; k++) {
+			level = (windows[k].lo + windows[k].hi) / 2;
+
+			for (j = 0; j < 2 * PHASE_SCANS + 2 * BOUNCE_SCANS + PHASE_SCANS; j++) {
+				if (j < PHASE_SCANS || j >= 2 * PHASE_SCANS + 2 * BOUNCE_SCANS) {
+					samples[0] = adc_clamp(ADC_IDLE + noise());
+				} else if (j < PHASE_SCANS + BOUNCE_SCANS ||
+						j >= 2 * PHASE_SCANS + BOUNCE_SCANS) {
+					samples[0] = adc_clamp((j & 1) ? ADC_IDLE + noise() : level + noise());
+				} else {
+					samples[0] = adc_clamp(level + noise());
+				}
+
+				feed(ladders, 1, samples, scan++, &last);
+			}
+		}
+
+		return 0;
+	}
+
+	f = fopen(name, "r");
+	if (!f) {
+		perror(name);
+		return 1;
+	}
+
+	while (fgets(line, sizeof(line), f)) {
+		p = line;
+		for (i = 0; i < MAX_LADDERS; i++) {
+			samples[i] = adc_clamp(strtol(p, &end, 0));
+			if (end == p) {
+				break;
+			}
+			p = end;
+		}
+
+		if (!i) {
+			continue;
+		}
+
+		// Number of ladders is defined by the first scan
+		if (!scan) {
+			n = i;
+			if (n * num_keys > KEYS_MASK_BITS) {
+				fprintf(stderr, "%u ladders of %u keys don't fit keys bitmask\n", n, num_keys);
+				fclose(f);
+				return 1;
+			}
+		}
+
+		feed(ladders, n, samples, scan++, &last);
+	}
+
+	fclose(f);
+
+	return 0;
+}